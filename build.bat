@@ -1 +1 @@
-@cl.exe /W2 /WX /O2 /nologo /Fe:uloc.exe uloc.c && mt.exe /nologo /manifest manifest.xml /outputresource:uloc.exe;#1
\ No newline at end of file
+@cl.exe /W2 /WX /O2 /nologo /Fe:uloc.exe uloc.c && mt.exe /nologo /manifest manifest.xml /outputresource:uloc.exe;#1 && cl.exe /W2 /WX /O2 /nologo /c libuloc.c && lib.exe /nologo /out:uloc.lib libuloc.obj
\ No newline at end of file
@@ -0,0 +1,4 @@
+// Translation unit for building uloc as a library, see uloc.h for the API
+
+#define ULOC_IMPLEMENTATION
+#include "uloc.h"
@@ -0,0 +1,73 @@
+// Prints stopTable and STOP_SEED for uloc.h, for adding or removing built in trivial lines. It
+// starts from the lines in the table now, adds the ones given as arguments, and keeps the current
+// seed if every line still gets a slot of its own. To remove a line, delete it from the table
+// first. Run it with `make stoptable LINES='"end do" "return self"'` and paste the output over the
+// old table.
+
+#define ULOC_IMPLEMENTATION
+#include "../uloc.h"
+
+#define STOP_TABLE_SIZE (1 << STOP_TABLE_BITS)
+
+// Fills `slots` with the index of the line in each slot, or -1. Returns false on a collision
+static bool placeLines(String *lines, uint4 seed, nat *slots) {
+	for(nat i = 0; i < STOP_TABLE_SIZE; i++) slots[i] = -1;
+	for(nat i = 0; i < arrlen(lines); i++) {
+		uint4 slot = stopHash(lines[i], seed) & (STOP_TABLE_SIZE - 1);
+		if(slots[slot] >= 0) return false;
+		slots[slot] = i;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	String *lines = NULL;
+	for(nat i = 0; i < STOP_TABLE_SIZE; i++) {
+		if(stopTable[i].start != NULL) arrput(lines, stopTable[i]);
+	}
+	
+	for(int i = 1; i < argc; i++) {
+		String line = {.size = strlen(argv[i]), .start = argv[i]};
+		if(line.size == 0 || line.size > STOP_MAX_SIZE || line.size != trimLine(line).size) {
+			fprintf(stderr, "Error: '%s' needs to be 1 to %d bytes, without spaces around it\n", argv[i], STOP_MAX_SIZE);
+			return 1;
+		}
+		
+		bool known = false;
+		for(nat j = 0; j < arrlen(lines); j++) {
+			if(compareStrings(lines[j], line) == 0) known = true;
+		}
+		if(!known) arrput(lines, line);
+	}
+	
+	// Seeds get tried in the same order every time, so the output only depends on the lines
+	nat slots[STOP_TABLE_SIZE];
+	uint4 seed = STOP_SEED;
+	uint8 tries = 0;
+	while(!placeLines(lines, seed, slots)) {
+		tries++;
+		if(tries > UINT32_MAX) {
+			fprintf(stderr, "Error: no seed places all %zu lines, make STOP_TABLE_BITS bigger\n", (unat)arrlen(lines));
+			return 1;
+		}
+		seed = (uint4)(tries * 0x9e3779b9u);
+	}
+	
+	printf("#define STOP_SEED 0x%08xu\n\n", seed);
+	printf("static const String stopTable[1 << STOP_TABLE_BITS] = {\n");
+	for(nat i = 0; i < STOP_TABLE_SIZE; i++) {
+		if(slots[i] < 0) continue;
+		
+		String line = lines[slots[i]];
+		printf("\t[%zu] = STOP_LINE(\"", (unat)i);
+		for(unat c = 0; c < line.size; c++) {
+			if(line.start[c] == '"' || line.start[c] == '\\') putchar('\\');
+			putchar(line.start[c]);
+		}
+		printf("\"),\n");
+	}
+	printf("};\n");
+	
+	arrfree(lines);
+	return 0;
+}
@@ -1,152 +1,25 @@
-#define MAJOR 0
-#define MINOR 4
-#define PATCH 1
-
 #define _STR(x) #x
 #define STR(x) _STR(x)
-#define VERSION (STR(MAJOR) "." STR(MINOR) "." STR(PATCH))
+#define VERSION (STR(ULOC_MAJOR) "." STR(ULOC_MINOR) "." STR(ULOC_PATCH))
 
-#define STB_DS_IMPLEMENTATION
-#include "stb_ds.h"
+#define ULOC_IMPLEMENTATION
+#include "uloc.h"
 #define JIM_IMPLEMENTATION
 #include "jim.h"
 
-#include <stdio.h>
-
-#ifdef _WIN32
-
-#define MINIRENT_IMPLEMENTATION
-#include "minirent.h"
-
-// These are already defined in minirent.h:
-// #define WIN32_LEAN_AND_MEAN
-// #include <windows.h>
+#include <time.h>
 
-#ifdef _WIN64
-#define ftello _ftelli64
-#else
-#define ftello ftell
+#ifdef __linux__
+#include <sys/inotify.h>
 #endif
 
-#else
-#include <dirent.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #endif
 
-#include <stdint.h>
-
-typedef  int64_t  int8;
-typedef  int32_t  int4;
-typedef  int16_t  int2;
-typedef   int8_t  int1;
-typedef uint64_t uint8;
-typedef uint32_t uint4;
-typedef uint16_t uint2;
-typedef  uint8_t uint1;
-
-typedef intptr_t  nat;
-typedef   size_t unat;
-
-typedef int bool;
-#define  true 1
-#define false 0
-
-#define structdef(name) typedef struct name name; struct name
-#define enumdef(name)   typedef enum   name name; enum   name
-
-structdef(FileData) {
-	unat size;
-	char data[0];
-};
-
-structdef(String) {
-	unat size;
-	char *start;
-};
-
-#define litToString(lit) ((String){.size = sizeof(lit) - 1, .start = lit})
-static inline String cstrToString(const char *cstr) {
-	return (String){
-		.size = strlen(cstr),
-		.start = (char*)cstr
-	};
-}
-
-structdef(FileInfo) {
-	String path;
-	String name;
-	String ext;
-	
-	unat lineCount;
-	unat lineCountUnique;
-	
-	FileData *data;
-};
-
-#define uloc_error(var, message) do {assert((var) != NULL); *(var) = (message); return NULL;} while(0)
-#define uloc_assert(condition, var, message) do {assert((var) != NULL); if(!(condition)) uloc_error((var), (message));} while(0)
-
-FileData *readFile(char *path, char **errorMessage) {
-	FILE *file = fopen(path, "rb");
-	uloc_assert(file != NULL, errorMessage, "could not open file");
-	
-	// Get file size first
-	fseek(file, 0, SEEK_END);
-	unat pos = ftello(file);
-	fseek(file, 0, SEEK_SET);
-	
-	if(pos == 0) return NULL;
-	
-	// Allocate enough memory for size + data
-	FileData *fdata = malloc(sizeof(FileData) + pos);
-	uloc_assert(fdata != NULL, errorMessage, "could not allocate memory");
-	
-	// Assign size
-	fdata->size = pos;
-	
-	// Read contents of file to memory
-	uloc_assert(fread(fdata->data, pos, 1, file) == 1, errorMessage, "failed to read file");
-	
-	fclose(file);
-	
-	return fdata;
-}
-
-static inline char toLower(char c) {
-	if(c >= 'A' && c <= 'Z') c += 32;
-	return c;
-}
-
-static inline bool isWhitespace(char c) {
-	return c == ' ' || c == '\t' || c == '\r';
-}
-
-bool matchInsensitive(String a, String b) {
-	if(a.size != b.size) return false;
-	
-	for(unat i = 0; i < a.size; i++) {
-		if(toLower(a.start[i]) != toLower(b.start[i])) return false;
-	}
-	
-	return true;
-}
-
-static inline int compareStrings(const String left, const String right) {
-	unat minSize = left.size;
-	if(right.size < minSize) minSize = right.size;
-	
-	int comparison = memcmp(left.start, right.start, minSize);
-	if(comparison == 0) {
-		if(left.size < right.size) return -1;
-		return left.size > right.size;
-	}
-	
-	return comparison;
-}
-
-static int compareLines(const void *a, const void *b) {
-	return compareStrings(*(const String*)a, *(const String*)b);
-}
-
 enumdef(OutputFormat) {
 	OUTPUT_DEFAULT,
 	OUTPUT_CSV,
@@ -154,6 +27,20 @@ enumdef(OutputFormat) {
 	OUTPUT_JSON,
 };
 
+enumdef(HistogramKind) {
+	HISTOGRAM_LENGTH,
+	HISTOGRAM_RATIO,
+	HISTOGRAM_COPIES,
+};
+
+enumdef(SortOrder) {
+	SORT_NONE,
+	SORT_RATIO,  // Lowest unique ratio first
+	SORT_UNIQUE, // Most unique lines first
+	SORT_LINES,  // Most source lines first
+	SORT_PATH,
+};
+
 void version(FILE *stream) {
 	if(stream == NULL) stream = stderr;
 	fprintf(stream, "uloc version %s\n", VERSION);
@@ -162,18 +49,103 @@ void version(FILE *stream) {
 void usage(FILE *stream) {
 	if(stream == NULL) stream = stderr;
 	fputs(
-		"Usage: uloc <file|directory|-option>...\n\n"
+		"Usage: uloc <file|directory|archive|-option>...\n"
+		"       uloc -git repository [-commits n] <revision|-option>...\n\n"
+		"Archives (.tar, .tar.gz, .tgz, .zip, .jar and .whl) get read without extracting\n"
+		"them, and .gz files get decompressed.\n\n"
 	, stream);
 	version(stream);
 	fputs(
 		"\n"
 		"Options:\n"
+		"    -         : read stdin, as a tar archive or a single file, gzipped or not\n"
 		"    -help     : show this help page\n"
 		"    -version  : get uloc version information\n"
 		"    -all      : don't ignore names that start with a dot\n"
 		"    -fslash   : use forward-slashes as directory separators\n"
 		"    -bslash   : use back-slashes as directory separators\n"
 		"    -name     : use file name instead of full path for output\n"
+		"    -nocomments\n"
+		"              : leave out comments, for file extensions uloc knows about\n"
+		"    -notrivial: leave out trivial lines like '}', 'break;' or '#endif'\n"
+		"    -stoplist file\n"
+		"              : leave out lines that appear in file (one per line)\n"
+		"    -normalize list\n"
+		"              : normalize lines before comparing them, list is comma separated:\n"
+		"                ws (collapse whitespace), case (ignore case),\n"
+		"                semicolon (ignore trailing semicolons) or all\n"
+		"    -mem-limit size\n"
+		"              : keep memory use around size bytes (K, M and G suffixes work),\n"
+		"                spilling lines to temporary files for the total. The files in\n"
+		"                archives and stdin still all get read into memory up front\n"
+		"    -git repository\n"
+		"              : count the files of commits in a git repository instead, args are\n"
+		"                revisions like HEAD, main, v1.0 or HEAD~3 (default HEAD)\n"
+		"    -commits n: with -git, count n commits back from each revision, following\n"
+		"                first parents\n"
+		"    -cache file\n"
+		"              : keep results in file between runs, keyed by the blob ids in\n"
+		"                .git/index, so files unchanged since they were staged don't get\n"
+		"                read again\n"
+		"    -since revision\n"
+		"              : only output files changed since revision (staged, modified or\n"
+		"                new), the total still covers every file. Goes well with -cache\n"
+		"    -compare old new\n"
+		"              : output how many lines in new (a file or directory) occur more than\n"
+		"                once, but didn't in old. Either can also be a file saved with\n"
+		"                -fingerprints\n"
+		"    -fingerprints file\n"
+		"              : save fingerprints of all lines to file, for -compare\n"
+		"    -build-index file\n"
+		"              : save fingerprints of all lines to file, with the files they occur\n"
+		"                in, for -query-index\n"
+		"    -query-index file\n"
+		"              : output how many lines of the files/directories given occur in the\n"
+		"                files saved to file with -build-index, and which files those are\n"
+		"    -approx error\n"
+		"              : estimate the unique total within about error (like 1% or 0.01)\n"
+		"                using a few kilobytes, instead of keeping every line around\n"
+		"    -sketch file\n"
+		"              : save the estimate of -approx to file\n"
+		"    -merge-sketch file\n"
+		"              : add a sketch saved by an earlier run to the total, can be given\n"
+		"                several times, and works without any files to scan\n"
+		"    -sort order\n"
+		"              : output files sorted by ratio (lowest first), unique or lines\n"
+		"                (most first) or path, instead of in the order they were found\n"
+		"    -top n    : only output the first n files, sorted by ratio unless -sort\n"
+		"                says otherwise. The total still covers every file\n"
+		"    -fail-below ratio\n"
+		"              : exit with status 2 if the unique ratio of the total is below\n"
+		"                ratio (like 0.8 or 80%)\n"
+		"    -fail-file-below ratio\n"
+		"              : exit with status 2 if the unique ratio of any file that gets\n"
+		"                output is below ratio, naming those files on stderr\n"
+		"    -fail-fast: with -fail-file-below, stop at the first file below it\n"
+		"    -deadline seconds\n"
+		"              : stop taking on files once seconds have passed, and output what\n"
+		"                was counted by then, marked as partial\n"
+		"    -max-files n\n"
+		"              : only count the first n files found, marked as partial if there\n"
+		"                were more\n"
+		"    -histograms\n"
+		"              : also output how line lengths, the unique ratios of files and\n"
+		"                the copies of each line within its file are distributed\n"
+		"                (default and JSON output only)\n"
+		"    -progress : show how far along scanning is on stderr\n"
+		"    -watch    : keep running, and output what changed whenever files change\n"
+		"                (Linux only)\n"
+		"    -serve socket\n"
+		"              : keep running after counting, and answer requests on a Unix domain\n"
+		"                socket (not on Windows). Requests and answers are lines:\n"
+		"                  scan PATH    count PATH (again)   -> ok FILES LINES UNIQUE\n"
+		"                  forget PATH  stop counting PATH   -> ok 0 LINES UNIQUE\n"
+		"                  file PATH                         -> ok LINES UNIQUE\n"
+		"                  line TEXT    occurrences of TEXT  -> ok COUNT\n"
+		"                  total                             -> ok FILES LINES UNIQUE\n"
+		"                  shutdown     stop the server      -> ok\n"
+		"                or error MESSAGE when something went wrong. Clients are served\n"
+		"                one at a time, each until it disconnects\n"
 		"    --        : interpret the rest of the args as files/directories\n"
 		"\n"
 		"Output:\n"
@@ -186,16 +158,89 @@ void usage(FILE *stream) {
 	, stream);
 }
 
+// Parses sizes like 512, 64K, 100M or 2G
+static bool parseSize(const char *text, unat *size) {
+	char *end;
+	unsigned long long value = strtoull(text, &end, 10);
+	if(end == text) return false;
+	
+	switch(toLower(end[0])) {
+		case 'k': value <<= 10; end++; break;
+		case 'm': value <<= 20; end++; break;
+		case 'g': value <<= 30; end++; break;
+	}
+	
+	if(toLower(end[0]) == 'b') end++;
+	if(end[0] != 0) return false;
+	
+	*size = value;
+	return true;
+}
+
+// Parses a comma separated list of normalizations like "ws,case"
+static bool parseNormalize(const char *text, int *normalize) {
+	String list = cstrToString(text);
+	while(list.size > 0) {
+		String item = {.start = list.start};
+		for(; item.size < list.size && item.start[item.size] != ','; item.size++) {}
+		
+		list.start += item.size;
+		list.size -= item.size;
+		if(list.size > 0) {
+			list.start++;
+			list.size--;
+		}
+		
+		if(matchInsensitive(item, litToString("ws")) || matchInsensitive(item, litToString("whitespace"))) {
+			*normalize |= ULOC_NORMALIZE_WHITESPACE;
+		} else if(matchInsensitive(item, litToString("case"))) {
+			*normalize |= ULOC_NORMALIZE_CASE;
+		} else if(matchInsensitive(item, litToString("semicolon")) || matchInsensitive(item, litToString("trailing-semicolon"))) {
+			*normalize |= ULOC_NORMALIZE_SEMICOLON;
+		} else if(matchInsensitive(item, litToString("all"))) {
+			*normalize |= ULOC_NORMALIZE_WHITESPACE | ULOC_NORMALIZE_CASE | ULOC_NORMALIZE_SEMICOLON;
+		} else {
+			return false;
+		}
+	}
+	
+	return *normalize != 0;
+}
+
+// Parses fractions like 0.01, or percentages like 1%
+static bool parseFraction(const char *text, double *value) {
+	char *end;
+	*value = strtod(text, &end);
+	if(end == text) return false;
+	
+	if(end[0] == '%') {
+		*value /= 100;
+		end++;
+	}
+	
+	return end[0] == 0 && *value >= 0 && *value <= 1;
+}
+
+static bool parseSortOrder(const char *text, SortOrder *order) {
+	String name = cstrToString(text);
+	if(matchInsensitive(name, litToString("ratio"))) *order = SORT_RATIO;
+	else if(matchInsensitive(name, litToString("unique"))) *order = SORT_UNIQUE;
+	else if(matchInsensitive(name, litToString("lines"))) *order = SORT_LINES;
+	else if(matchInsensitive(name, litToString("path"))) *order = SORT_PATH;
+	else return false;
+	return true;
+}
+
 static void outputLineDefault(FILE *stream, char *path, unat ulines, unat slines) {
 	float percent = ulines * 100.0f / slines;
 	fprintf(stream, "    %s: %zu/%zu : %.1f%%\n", path, ulines, slines, percent);
 }
 
-static void outputLineValues(FILE *stream, OutputFormat outputFormat, FileInfo *finfo) {
-	char *filepath = finfo->path.start;
+static void outputLineValues(FILE *stream, OutputFormat outputFormat, FileInfo *finfo, char *filepath) {
 	char *filename = finfo->name.start;
-	char *fileext = finfo->ext.start;
-	if(fileext == NULL) fileext = "none";
+	
+	// Extensions aren't always at the end of the name, like ".c" in "main.c.gz"
+	String fileext = finfo->ext.start != NULL ? finfo->ext : litToString("none");
 	
 	unat ulines = finfo->lineCountUnique;
 	unat slines = finfo->lineCount;
@@ -203,124 +248,1654 @@ static void outputLineValues(FILE *stream, OutputFormat outputFormat, FileInfo *
 	
 	switch(outputFormat) {
 		case OUTPUT_CSV: {
-			fprintf(stream, "%s,%s,%s,%zu,%zu,%f\n", filepath, filename, fileext, ulines, slines, ratio);
+			fprintf(stream, "%s,%s,%.*s,%zu,%zu,%f\n", filepath, filename, (int)fileext.size, fileext.start, ulines, slines, ratio);
 		} break;
 		case OUTPUT_TSV: {
-			fprintf(stream, "%s\t%s\t%s\t%zu\t%zu\t%f\n", filepath, filename, fileext, ulines, slines, ratio);
+			fprintf(stream, "%s\t%s\t%.*s\t%zu\t%zu\t%f\n", filepath, filename, (int)fileext.size, fileext.start, ulines, slines, ratio);
 		} break;
 	}
 }
 
-int main(int argc, char *argv[]) {
+static void outputFileResult(FILE *stream, Jim *jim, OutputFormat outputFormat, FileInfo *finfo, String path, bool nameOnly) {
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			outputLineDefault(stream, nameOnly ? finfo->name.start : path.start, finfo->lineCountUnique, finfo->lineCount);
+		} break;
+		case OUTPUT_CSV:
+		case OUTPUT_TSV: {
+			outputLineValues(stream, outputFormat, finfo, path.start);
+		} break;
+		case OUTPUT_JSON: {
+			jim_object_begin(jim);
+				jim_member_key(jim, "path");
+				jim_string_sized(jim, path.start, path.size);
+				
+				jim_member_key(jim, "name");
+				jim_string_sized(jim, finfo->name.start, finfo->name.size);
+				
+				jim_member_key(jim, "extension");
+				jim_string_sized(jim, finfo->ext.start, finfo->ext.size);
+				
+				jim_member_key(jim, "uniqueLines");
+				jim_integer(jim, finfo->lineCountUnique);
+				
+				jim_member_key(jim, "sourceLines");
+				jim_integer(jim, finfo->lineCount);
+				
+				jim_member_key(jim, "ratio");
+				jim_float(jim, (double)finfo->lineCountUnique / finfo->lineCount, 5);
+			jim_object_end(jim);
+		}
+	}
+}
+
+// The range of a bucket, with `max` 0 for the last bucket of lengths and copies, which has no end.
+// Ratios are in percent
+static void bucketRange(HistogramKind kind, int bucket, unat *min, unat *max) {
+	switch(kind) {
+		case HISTOGRAM_LENGTH: {
+			*min = (unat)1 << bucket;
+			*max = bucket + 1 < LENGTH_BUCKETS ? ((unat)2 << bucket) - 1 : 0;
+		} break;
+		case HISTOGRAM_RATIO: {
+			*min = bucket * 100 / RATIO_BUCKETS;
+			*max = (bucket + 1) * 100 / RATIO_BUCKETS;
+		} break;
+		case HISTOGRAM_COPIES: {
+			*min = bucket > 0 ? ((unat)1 << (bucket - 1)) + 1 : 1;
+			*max = bucket + 1 < COPIES_BUCKETS ? (unat)1 << bucket : 0;
+		} break;
+	}
+}
+
+static void outputHistogram(FILE *stream, Jim *jim, OutputFormat outputFormat, char *title, char *key, HistogramKind kind, unat *counts, int bucketCount) {
+	unat total = 0;
+	for(int i = 0; i < bucketCount; i++) total += counts[i];
 	
-	////////////////////////////////////////
-	/// Enable UTF8 binary IO on Windows ///
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			fprintf(stream, "\n%s:\n", title);
+			for(int i = 0; i < bucketCount; i++) {
+				unat min, max;
+				bucketRange(kind, i, &min, &max);
+				
+				char label[64];
+				if(kind == HISTOGRAM_RATIO) snprintf(label, sizeof(label), "%zu-%zu%%", min, max);
+				else if(max == 0) snprintf(label, sizeof(label), "%zu+", min);
+				else if(min == max) snprintf(label, sizeof(label), "%zu", min);
+				else snprintf(label, sizeof(label), "%zu-%zu", min, max);
+				
+				outputLineDefault(stream, label, counts[i], total);
+			}
+		} break;
+		case OUTPUT_JSON: {
+			jim_member_key(jim, key);
+			jim_array_begin(jim);
+			for(int i = 0; i < bucketCount; i++) {
+				unat min, max;
+				bucketRange(kind, i, &min, &max);
+				
+				jim_object_begin(jim);
+					jim_member_key(jim, "min");
+					if(kind == HISTOGRAM_RATIO) jim_float(jim, min / 100.0, 2);
+					else jim_integer(jim, min);
+					
+					if(max != 0) {
+						jim_member_key(jim, "max");
+						if(kind == HISTOGRAM_RATIO) jim_float(jim, max / 100.0, 2);
+						else jim_integer(jim, max);
+					}
+					
+					jim_member_key(jim, "count");
+					jim_integer(jim, counts[i]);
+				jim_object_end(jim);
+			}
+			jim_array_end(jim);
+		} break;
+		default: break;
+	}
+}
+
+// Outputs every histogram, after the total
+static void outputHistograms(FILE *stream, Jim *jim, OutputFormat outputFormat, Histograms *histograms) {
+	if(outputFormat == OUTPUT_JSON) {
+		jim_member_key(jim, "histograms");
+		jim_object_begin(jim);
+	}
 	
-	// NOTE: manifest.xml should be applied to the executable, so that argv is UTF8 rather than ASCII
+	outputHistogram(stream, jim, outputFormat, "Line lengths", "lineLength", HISTOGRAM_LENGTH, histograms->lineLength, LENGTH_BUCKETS);
+	outputHistogram(stream, jim, outputFormat, "Unique ratio of files", "fileRatio", HISTOGRAM_RATIO, histograms->fileRatio, RATIO_BUCKETS);
+	outputHistogram(stream, jim, outputFormat, "Copies of each line within its file", "lineCopies", HISTOGRAM_COPIES, histograms->lineCopies, COPIES_BUCKETS);
 	
-	#ifdef _WIN32
-		_setmode(0, 0x8000);
-		_setmode(1, 0x8000);
-		SetConsoleCP(CP_UTF8);
-		SetConsoleOutputCP(CP_UTF8);
-	#endif
+	if(outputFormat == OUTPUT_JSON) jim_object_end(jim);
+}
+
+// A counted file waiting to be output in order. `key` goes up in output order, and `path` is only
+// set when sorting by path
+structdef(RankedFile) {
+	nat index;
+	double key;
+	char *path;
+};
+
+static int compareRankedFiles(const void *left, const void *right) {
+	const RankedFile *a = left;
+	const RankedFile *b = right;
 	
-	/// Enable UTF8 binary IO on Windows ///
-	////////////////////////////////////////
+	int order = a->path != NULL ? strcmp(a->path, b->path) : (a->key > b->key) - (a->key < b->key);
+	if(order != 0) return order;
 	
-	if(argc <= 1) {
-		fputs("Error: got no arguments\n\n", stderr);
-		usage(stderr);
-		return 1;
+	// Otherwise keep the order they were found in
+	return (a->index > b->index) - (a->index < b->index);
+}
+
+// The path is still in the path buffer of `uloc`, and only gets copied for files that are kept
+static RankedFile rankFile(Uloc *uloc, nat index, SortOrder order) {
+	FileInfo *finfo = uloc->files + index;
+	RankedFile ranked = {.index = index};
+	
+	switch(order) {
+		case SORT_NONE:
+		case SORT_RATIO: ranked.key = finfo->lineCount > 0 ? (double)finfo->lineCountUnique / finfo->lineCount : 1; break;
+		case SORT_UNIQUE: ranked.key = -(double)finfo->lineCountUnique; break;
+		case SORT_LINES: ranked.key = -(double)finfo->lineCount; break;
+		case SORT_PATH: ranked.path = ulocFilePath(uloc, finfo).start; break;
 	}
 	
-	FileInfo *files = NULL;
+	return ranked;
+}
+
+static inline void swapRankedFiles(RankedFile *a, RankedFile *b) {
+	RankedFile swap = *a;
+	*a = *b;
+	*b = swap;
+}
+
+// Keeps the first `limit` files in output order in a heap with the last of them on top, so files
+// that don't make it cost one comparison, and nothing more than `limit` files is ever kept
+static void keepTopFile(RankedFile **heap, unat limit, RankedFile file) {
+	RankedFile *files = *heap;
+	unat count = arrlen(files);
 	
-	#ifdef _WIN32
-	char slash = '\\';
-	#else
-	char slash = '/';
-	#endif
+	if(count == limit) {
+		if(compareRankedFiles(&file, files) >= 0) return;
+		
+		free(files[0].path);
+		if(file.path != NULL) file.path = strdup(file.path);
+		files[0] = file;
+		
+		for(unat parent = 0;;) {
+			unat child = parent * 2 + 1;
+			if(child >= count) break;
+			if(child + 1 < count && compareRankedFiles(files + child + 1, files + child) > 0) child++;
+			if(compareRankedFiles(files + parent, files + child) >= 0) break;
+			
+			swapRankedFiles(files + parent, files + child);
+			parent = child;
+		}
+		return;
+	}
 	
-	bool dotfiles = false;
-	bool outputHeader = true;
-	bool nameOnly = false;
-	char *outputFilename = NULL;
+	if(file.path != NULL) file.path = strdup(file.path);
+	arrput(*heap, file);
+	files = *heap;
 	
-	OutputFormat outputFormat = OUTPUT_DEFAULT;
+	for(unat child = count; child > 0;) {
+		unat parent = (child - 1) / 2;
+		if(compareRankedFiles(files + parent, files + child) >= 0) break;
+		
+		swapRankedFiles(files + parent, files + child);
+		child = parent;
+	}
+}
+
+static FILE *openOutput(char *outputFilename) {
+	if(outputFilename == NULL) return stdout;
 	
-	////////////////////////////
-	/// CLI argument parsing ///
+	FILE *outputStream = fopen(outputFilename, "wb");
+	if(outputStream == NULL) {
+		fprintf(stderr, "Error: could not open output file for writing\n");
+	}
+	return outputStream;
+}
+
+static int closeOutput(FILE *outputStream) {
+	if(outputStream != stdout && outputStream != stderr) {
+		if(fclose(outputStream) != 0) {
+			fprintf(stderr, "Error: could not close output file\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Counts the files of every commit from `revisions`, each going `commitCount` commits back. The
+// commits of a revision get printed oldest first, so the output reads as a trend
+static int countGitHistory(Uloc *uloc, char *repoPath, char **revisions, unat commitCount, OutputFormat outputFormat, bool outputHeader, char *outputFilename) {
+	GitHistory history;
+	char *errorMessage = NULL;
+	if(!gitHistoryOpen(&history, repoPath, &errorMessage)) {
+		fprintf(stderr, "Error: %s: %s\n", repoPath, errorMessage);
+		return 1;
+	}
 	
-	bool wantOptions = true;
+	int status = 0;
 	
-	for(int i = 1; i < argc; i++) {
-		String arg = cstrToString(argv[i]);
-		if(wantOptions && arg.size > 0 && arg.start[0] == '-') {
-			if(compareStrings(arg, litToString("-")) == 0) {
-				// TODO: handle stdin input
-				continue;
-			}
+	uint1 (*commits)[GIT_ID_SIZE] = NULL;
+	for(int i = 0; i < arrlen(revisions); i++) {
+		uint1 id[GIT_ID_SIZE];
+		if(!gitResolve(&history.repo, revisions[i], id)) {
+			fprintf(stderr, "Error: could not resolve revision %s\n", revisions[i]);
+			status = 1;
+			continue;
+		}
+		
+		nat first = arrlen(commits);
+		for(unat c = 0; c < commitCount; c++) {
+			memcpy(arraddnptr(commits, 1), id, GIT_ID_SIZE);
 			
-			if(compareStrings(arg, litToString("--")) == 0) {
-				wantOptions = false;
-				continue;
+			GitCommit commit;
+			if(c + 1 == commitCount || !gitReadCommit(&history.repo, id, &commit) || !commit.hasParent) break;
+			memcpy(id, commit.parent, GIT_ID_SIZE);
+		}
+		
+		for(nat a = first, b = arrlen(commits) - 1; a < b; a++, b--) {
+			memcpy(id, commits[a], GIT_ID_SIZE);
+			memcpy(commits[a], commits[b], GIT_ID_SIZE);
+			memcpy(commits[b], id, GIT_ID_SIZE);
+		}
+	}
+	
+	FILE *outputStream = openOutput(outputFilename);
+	if(outputStream == NULL) return 1;
+	
+	Jim jim = (Jim) {
+		.sink = outputStream,
+		.write = (Jim_Write) fwrite,
+	};
+	
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			fputs("Unique lines per commit:\n", outputStream);
+		} break;
+		case OUTPUT_CSV: {
+			if(outputHeader) {
+				fputs("commit,date,files,unique lines,source lines,ratio\n", outputStream);
 			}
-			
-			// Tolerate double dashes
-			if(arg.size >= 2 && arg.start[1] == '-') {
-				arg.size--;
-				arg.start++;
+		} break;
+		case OUTPUT_TSV: {
+			if(outputHeader) {
+				fputs("commit\tdate\tfiles\tunique lines\tsource lines\tratio\n", outputStream);
 			}
+		} break;
+		case OUTPUT_JSON: {
+			jim_object_begin(&jim);
 			
-			if(matchInsensitive(arg, litToString("-help"))) {
-				usage(stdout);
-				return 0;
-			}
+			jim_member_key(&jim, "commitCount");
+			jim_integer(&jim, arrlen(commits));
 			
-			if(matchInsensitive(arg, litToString("-version"))) {
-				version(stdout);
-				return 0;
+			jim_member_key(&jim, "commits");
+			jim_array_begin(&jim);
+		}
+	}
+	
+	for(int i = 0; i < arrlen(commits); i++) {
+		char hex[GIT_ID_SIZE * 2 + 1];
+		formatGitId(commits[i], hex);
+		
+		GitCommitCount count;
+		if(!countGitCommit(uloc, &history, commits[i], &count)) {
+			fprintf(stderr, "Error: commit %s: %s\n", hex, uloc->error);
+			status = 1;
+			continue;
+		}
+		
+		char date[32] = "unknown";
+		time_t time = (time_t)count.commit.time;
+		struct tm *utc = gmtime(&time);
+		if(utc != NULL) strftime(date, sizeof(date), "%Y-%m-%d", utc);
+		
+		float ratio = (float)count.lineCountUnique / count.lineCount;
+		
+		switch(outputFormat) {
+			case OUTPUT_DEFAULT: {
+				char label[64];
+				snprintf(label, sizeof(label), "%.12s %s", hex, date);
+				outputLineDefault(outputStream, label, count.lineCountUnique, count.lineCount);
+			} break;
+			case OUTPUT_CSV: {
+				fprintf(outputStream, "%s,%s,%zu,%zu,%zu,%f\n", hex, date, count.fileCount, count.lineCountUnique, count.lineCount, ratio);
+			} break;
+			case OUTPUT_TSV: {
+				fprintf(outputStream, "%s\t%s\t%zu\t%zu\t%zu\t%f\n", hex, date, count.fileCount, count.lineCountUnique, count.lineCount, ratio);
+			} break;
+			case OUTPUT_JSON: {
+				jim_object_begin(&jim);
+					jim_member_key(&jim, "commit");
+					jim_string(&jim, hex);
+					
+					jim_member_key(&jim, "time");
+					jim_integer(&jim, count.commit.time);
+					
+					jim_member_key(&jim, "subject");
+					jim_string(&jim, count.commit.subject);
+					
+					jim_member_key(&jim, "fileCount");
+					jim_integer(&jim, count.fileCount);
+					
+					jim_member_key(&jim, "uniqueLines");
+					jim_integer(&jim, count.lineCountUnique);
+					
+					jim_member_key(&jim, "sourceLines");
+					jim_integer(&jim, count.lineCount);
+					
+					jim_member_key(&jim, "ratio");
+					jim_float(&jim, (double)count.lineCountUnique / count.lineCount, 5);
+				jim_object_end(&jim);
 			}
-			
-			if(matchInsensitive(arg, litToString("-all"))) {
-				dotfiles = true;
+		}
+	}
+	
+	if(outputFormat == OUTPUT_JSON) {
+		jim_array_end(&jim);
+		
+		// Every blob gets counted once, no matter how many commits it's part of
+		jim_member_key(&jim, "blobCount");
+		jim_integer(&jim, hmlen(history.blobs));
+		
+		jim_object_end(&jim);
+	}
+	
+	arrfree(commits);
+	gitHistoryClose(&history);
+	
+	if(closeOutput(outputStream) != 0) return 1;
+	return status;
+}
+
+// Gets the fingerprint totals of one side of -compare, from a saved set or by scanning. Returns
+// false if something couldn't be read
+static bool compareSide(Uloc *uloc, char *path, Fingerprint **totals, bool *scanned) {
+	uint8 settings;
+	*scanned = false;
+	if(loadFingerprints(path, totals, &settings)) {
+		if(settings != ulocSettings(uloc)) {
+			fprintf(stderr, "Warning: %s was saved with different options, results will be off\n", path);
+		}
+		return true;
+	}
+	
+	nat first = arrlen(uloc->files);
+	bool ok = uloc_scanPath(uloc, path) == 0;
+	if(!ok) fprintf(stderr, "Error: %s: %s\n", path, uloc->error);
+	if(arrlen(uloc->files) == first) {
+		fprintf(stderr, "Error: %s: no files to scan\n", path);
+		ok = false;
+	}
+	
+	*totals = fingerprintTotals(uloc, first, arrlen(uloc->files));
+	*scanned = true;
+	return ok;
+}
+
+// Outputs the lines that occur more than once in `newPath`, but didn't in `oldPath`
+static int compareScans(Uloc *uloc, char *oldPath, char *newPath, OutputFormat outputFormat, bool outputHeader, char *outputFilename, bool nameOnly) {
+	uloc->collectFingerprints = true;
+	int status = 0;
+	
+	Fingerprint *before, *after;
+	bool newScanned;
+	if(!compareSide(uloc, oldPath, &before, &newScanned)) status = 1;
+	
+	nat firstNew = arrlen(uloc->files);
+	if(!compareSide(uloc, newPath, &after, &newScanned)) status = 1;
+	
+	Fingerprint *fresh = newlyDuplicated(before, arrlen(before), after, arrlen(after));
+	
+	unat totalLines = 0, totalFresh = 0;
+	for(nat i = 0; i < arrlen(after); i++) totalLines += after[i].count;
+	for(nat i = 0; i < arrlen(fresh); i++) totalFresh += fresh[i].count;
+	
+	// Files are only there if new got scanned, rather than loaded from saved fingerprints
+	unat *fileFresh = NULL;
+	nat outputFileCount = 0;
+	for(nat f = firstNew; newScanned && f < arrlen(uloc->files); f++) {
+		unat start = uloc->fingerprintOffsets[f];
+		unat end = f + 1 < arrlen(uloc->fingerprintOffsets) ? uloc->fingerprintOffsets[f + 1] : arrlen(uloc->fingerprints);
+		
+		unat count = 0;
+		for(unat i = start; i < end; i++) {
+			if(findFingerprint(fresh, arrlen(fresh), uloc->fingerprints[i].hash) != NULL) count += uloc->fingerprints[i].count;
+		}
+		
+		arrput(fileFresh, count);
+		outputFileCount += count > 0;
+	}
+	
+	FILE *outputStream = openOutput(outputFilename);
+	if(outputStream == NULL) return 1;
+	
+	Jim jim = (Jim) {
+		.sink = outputStream,
+		.write = (Jim_Write) fwrite,
+	};
+	
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			fputs("Newly duplicated lines:\n", outputStream);
+		} break;
+		case OUTPUT_CSV: {
+			if(outputHeader) {
+				fputs("filepath,filename,fileext,newly duplicated lines,source lines,ratio\n", outputStream);
+			}
+		} break;
+		case OUTPUT_TSV: {
+			if(outputHeader) {
+				fputs("filepath\tfilename\tfileext\tnewly duplicated lines\tsource lines\tratio\n", outputStream);
+			}
+		} break;
+		case OUTPUT_JSON: {
+			jim_object_begin(&jim);
+			
+			jim_member_key(&jim, "fileCount");
+			jim_integer(&jim, outputFileCount);
+			
+			jim_member_key(&jim, "files");
+			jim_array_begin(&jim);
+		}
+	}
+	
+	for(nat i = 0; i < arrlen(fileFresh); i++) {
+		if(fileFresh[i] == 0) continue;
+		
+		nat f = firstNew + i;
+		FileInfo *finfo = uloc->files + f;
+		String path = ulocFilePath(uloc, finfo);
+		
+		// Fingerprints of a file line up with its run of unique lines
+		FileInfo values = *finfo;
+		values.lineCountUnique = fileFresh[i];
+		
+		switch(outputFormat) {
+			case OUTPUT_DEFAULT: {
+				outputLineDefault(outputStream, nameOnly ? finfo->name.start : path.start, fileFresh[i], finfo->lineCount);
+			} break;
+			case OUTPUT_CSV:
+			case OUTPUT_TSV: {
+				outputLineValues(outputStream, outputFormat, &values, path.start);
+			} break;
+			case OUTPUT_JSON: {
+				jim_object_begin(&jim);
+					jim_member_key(&jim, "path");
+					jim_string_sized(&jim, path.start, path.size);
+					
+					jim_member_key(&jim, "name");
+					jim_string_sized(&jim, finfo->name.start, finfo->name.size);
+					
+					jim_member_key(&jim, "extension");
+					jim_string_sized(&jim, finfo->ext.start, finfo->ext.size);
+					
+					jim_member_key(&jim, "newlyDuplicatedLines");
+					jim_integer(&jim, fileFresh[i]);
+					
+					jim_member_key(&jim, "sourceLines");
+					jim_integer(&jim, finfo->lineCount);
+					
+					jim_member_key(&jim, "lines");
+					jim_array_begin(&jim);
+					
+					LineRun run = memoryRun(uloc, f);
+					Fingerprint *fingerprints = uloc->fingerprints + uloc->fingerprintOffsets[f];
+					for(unat l = 0; l < run.count; l++) {
+						if(findFingerprint(fresh, arrlen(fresh), fingerprints[l].hash) == NULL) continue;
+						jim_string_sized(&jim, run.lines[l].start, run.lines[l].size);
+					}
+					
+					jim_array_end(&jim);
+				jim_object_end(&jim);
+			}
+		}
+	}
+	
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			if(outputFileCount > 0) fputc('\n', outputStream);
+			outputLineDefault(outputStream, "total", totalFresh, totalLines);
+			fprintf(outputStream, "    distinct: %zu\n", (unat)arrlen(fresh));
+		} break;
+		case OUTPUT_JSON: {
+			jim_array_end(&jim);
+			
+			jim_member_key(&jim, "totalNewlyDuplicatedLines");
+			jim_integer(&jim, totalFresh);
+			
+			jim_member_key(&jim, "distinctNewlyDuplicatedLines");
+			jim_integer(&jim, arrlen(fresh));
+			
+			jim_member_key(&jim, "totalSourceLines");
+			jim_integer(&jim, totalLines);
+			
+			jim_object_end(&jim);
+		} break;
+	}
+	
+	arrfree(before);
+	arrfree(after);
+	arrfree(fresh);
+	arrfree(fileFresh);
+	
+	if(closeOutput(outputStream) != 0) return 1;
+	return status;
+}
+
+structdef(ProgressTicker) {
+	Uloc *uloc;
+	Thread thread;
+	bool running;
+	volatile nat stop;
+};
+
+// Redraws one status line on stderr a few times a second, from the counters the scan keeps
+static THREAD_FUNCTION(progressTicker) {
+	ProgressTicker *ticker = argument;
+	UlocProgress *progress = &ticker->uloc->progress;
+	
+	// Rates are measured from when counting was first seen, not from when it started
+	double countingStart = 0;
+	nat countedBefore = 0, bytesBefore = 0;
+	int lastSize = 0;
+	while(!atomicLoad(&ticker->stop)) {
+		nat phase = atomicLoad(&progress->phase);
+		nat found = atomicLoad(&progress->filesFound);
+		char status[256];
+		int size = 0;
+		
+		if(phase == PROGRESS_FINDING) {
+			size = snprintf(status, sizeof(status), "Finding files: %zu in %zu directories", (unat)found, (unat)atomicLoad(&progress->dirs));
+		} else if(phase == PROGRESS_READING) {
+			size = snprintf(status, sizeof(status), "Reading files: %zu/%zu", (unat)atomicLoad(&progress->filesRead), (unat)found);
+		} else if(phase == PROGRESS_COUNTING) {
+			nat counted = atomicLoad(&progress->filesCounted);
+			nat bytes = atomicLoad(&progress->bytes);
+			if(countingStart == 0) {
+				countingStart = monotonicSeconds();
+				countedBefore = counted;
+				bytesBefore = bytes;
+			}
+			
+			size = snprintf(status, sizeof(status), "Counting lines: %zu/%zu files, %zu lines", (unat)counted, (unat)found, (unat)atomicLoad(&progress->lines));
+			
+			double elapsed = monotonicSeconds() - countingStart;
+			if(elapsed >= 0.5 && counted > countedBefore && size < (int)sizeof(status)) {
+				double megabytes = (bytes - bytesBefore) / (1024.0 * 1024.0);
+				unat eta = elapsed * (found - counted) / (counted - countedBefore);
+				size += snprintf(status + size, sizeof(status) - size, ", %.1f MB/s, ETA %zu:%02zu", megabytes / elapsed, eta / 60, eta % 60);
+			}
+		} else if(phase == PROGRESS_TOTAL) {
+			size = snprintf(status, sizeof(status), "Merging lines for the total: %zu lines", (unat)atomicLoad(&progress->lines));
+		}
+		if(size >= (int)sizeof(status)) size = sizeof(status) - 1;
+		
+		// Pad with spaces to cover up longer lines from before
+		fprintf(stderr, "\r%s%*s", status, lastSize > size ? lastSize - size : 0, "");
+		fflush(stderr);
+		lastSize = size;
+		
+		// Redraw every 250ms, but notice being stopped sooner
+		for(int i = 0; i < 5 && !atomicLoad(&ticker->stop); i++) sleepMilliseconds(50);
+	}
+	
+	fprintf(stderr, "\r%*s\r", lastSize, "");
+	fflush(stderr);
+	return THREAD_RETURN;
+}
+
+static void startProgress(ProgressTicker *ticker) {
+	ticker->running = threadStart(&ticker->thread, progressTicker, ticker);
+}
+
+static void stopProgress(ProgressTicker *ticker) {
+	if(!ticker->running) return;
+	atomicStore(&ticker->stop, 1);
+	threadJoin(ticker->thread);
+	ticker->running = false;
+}
+
+static void outputLineDelta(FILE *stream, char *path, unat ulines, unat slines, int8 udelta, int8 sdelta) {
+	float percent = ulines * 100.0f / slines;
+	fprintf(stream, "    %s: %zu/%zu : %.1f%% (%+lld/%+lld)\n", path, ulines, slines, percent, (long long)udelta, (long long)sdelta);
+}
+
+structdef(SharedFile) {
+	uint4 key; // File id in the line index
+	unat value; // Lines shared with it
+};
+
+static int compareSharedFiles(const void *left, const void *right) {
+	const SharedFile *a = left;
+	const SharedFile *b = right;
+	if(a->value != b->value) return (a->value < b->value) - (a->value > b->value);
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+// Outputs how many lines of every file in `paths` occur in the files of a saved line index
+static int queryLineIndex(Uloc *uloc, char *indexPath, char **paths, OutputFormat outputFormat, bool outputHeader, char *outputFilename, bool nameOnly) {
+	LineIndex index;
+	if(!openLineIndex(indexPath, &index)) {
+		fprintf(stderr, "Error: %s is not a line index saved with -build-index\n", indexPath);
+		return 1;
+	}
+	if(index.settings != ulocSettings(uloc)) {
+		fprintf(stderr, "Warning: %s was saved with different options, results will be off\n", indexPath);
+	}
+	
+	uloc->collectFingerprints = true;
+	int status = 0;
+	for(nat i = 0; i < arrlen(paths); i++) {
+		if(uloc_scanPath(uloc, paths[i]) != 0) {
+			fprintf(stderr, "Error: %s: %s\n", paths[i], uloc->error);
+			status = 1;
+		}
+	}
+	
+	FILE *outputStream = openOutput(outputFilename);
+	if(outputStream == NULL) return 1;
+	
+	Jim jim = (Jim) {
+		.sink = outputStream,
+		.write = (Jim_Write) fwrite,
+	};
+	
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			fprintf(outputStream, "Lines found in %s:\n", indexPath);
+		} break;
+		case OUTPUT_CSV: {
+			if(outputHeader) {
+				fputs("filepath,filename,fileext,lines found,source lines,ratio\n", outputStream);
+			}
+		} break;
+		case OUTPUT_TSV: {
+			if(outputHeader) {
+				fputs("filepath\tfilename\tfileext\tlines found\tsource lines\tratio\n", outputStream);
+			}
+		} break;
+		case OUTPUT_JSON: {
+			jim_object_begin(&jim);
+			
+			jim_member_key(&jim, "fileCount");
+			jim_integer(&jim, arrlen(uloc->files));
+			
+			jim_member_key(&jim, "files");
+			jim_array_begin(&jim);
+		}
+	}
+	
+	unat totalFound = 0;
+	SharedFile *shared = NULL;
+	SharedFile *ranked = NULL; // Plain stb_ds array, sorting `shared` itself would break its hash index
+	for(nat f = 0; f < arrlen(uloc->files); f++) {
+		FileInfo *finfo = uloc->files + f;
+		String path = ulocFilePath(uloc, finfo);
+		
+		unat start = uloc->fingerprintOffsets[f];
+		unat end = f + 1 < arrlen(uloc->fingerprintOffsets) ? uloc->fingerprintOffsets[f + 1] : arrlen(uloc->fingerprints);
+		
+		unat found = 0;
+		hmfree(shared);
+		for(unat i = start; i < end; i++) {
+			const LineIndexEntry *entry = lineIndexFind(&index, uloc->fingerprints[i].hash);
+			if(entry == NULL) continue;
+			found += uloc->fingerprints[i].count;
+			
+			unat ownerCount;
+			const uint4 *owners = lineIndexOwners(&index, entry, &ownerCount);
+			for(unat o = 0; o < ownerCount; o++) {
+				nat at = hmgeti(shared, owners[o]);
+				if(at < 0) hmput(shared, owners[o], uloc->fingerprints[i].count);
+				else shared[at].value += uloc->fingerprints[i].count;
+			}
+		}
+		totalFound += found;
+		
+		// Most shared first
+		nat sharedCount = hmlen(shared);
+		arrsetlen(ranked, sharedCount);
+		if(sharedCount > 0) {
+			memcpy(ranked, shared, sharedCount * sizeof(*ranked));
+			qsort(ranked, sharedCount, sizeof(*ranked), compareSharedFiles);
+		}
+		
+		FileInfo values = *finfo;
+		values.lineCountUnique = found;
+		
+		switch(outputFormat) {
+			case OUTPUT_DEFAULT: {
+				outputLineDefault(outputStream, nameOnly ? finfo->name.start : path.start, found, finfo->lineCount);
+				
+				nat shownCount = sharedCount < 5 ? sharedCount : 5;
+				for(nat s = 0; s < shownCount; s++) {
+					fprintf(outputStream, "        %zu in %s\n", ranked[s].value, lineIndexPath(&index, ranked[s].key));
+				}
+				if(sharedCount > shownCount) {
+					fprintf(outputStream, "        and %zu more files\n", (unat)(sharedCount - shownCount));
+				}
+			} break;
+			case OUTPUT_CSV:
+			case OUTPUT_TSV: {
+				outputLineValues(outputStream, outputFormat, &values, path.start);
+			} break;
+			case OUTPUT_JSON: {
+				jim_object_begin(&jim);
+					jim_member_key(&jim, "path");
+					jim_string_sized(&jim, path.start, path.size);
+					
+					jim_member_key(&jim, "name");
+					jim_string_sized(&jim, finfo->name.start, finfo->name.size);
+					
+					jim_member_key(&jim, "extension");
+					jim_string_sized(&jim, finfo->ext.start, finfo->ext.size);
+					
+					jim_member_key(&jim, "foundLines");
+					jim_integer(&jim, found);
+					
+					jim_member_key(&jim, "sourceLines");
+					jim_integer(&jim, finfo->lineCount);
+					
+					jim_member_key(&jim, "sharedWith");
+					jim_array_begin(&jim);
+					for(nat s = 0; s < sharedCount; s++) {
+						jim_object_begin(&jim);
+							jim_member_key(&jim, "path");
+							jim_string(&jim, lineIndexPath(&index, ranked[s].key));
+							
+							jim_member_key(&jim, "lines");
+							jim_integer(&jim, ranked[s].value);
+						jim_object_end(&jim);
+					}
+					jim_array_end(&jim);
+				jim_object_end(&jim);
+			}
+		}
+	}
+	hmfree(shared);
+	arrfree(ranked);
+	
+	switch(outputFormat) {
+		case OUTPUT_DEFAULT: {
+			fputc('\n', outputStream);
+			outputLineDefault(outputStream, "total", totalFound, uloc->lineCount);
+		} break;
+		case OUTPUT_JSON: {
+			jim_array_end(&jim);
+			
+			jim_member_key(&jim, "totalFoundLines");
+			jim_integer(&jim, totalFound);
+			
+			jim_member_key(&jim, "totalSourceLines");
+			jim_integer(&jim, uloc->lineCount);
+			
+			jim_object_end(&jim);
+		} break;
+	}
+	
+	closeLineIndex(&index);
+	arrfree(paths);
+	
+	if(closeOutput(outputStream) != 0) return 1;
+	return status;
+}
+
+#ifdef __linux__
+
+structdef(WatchedDir) {
+	int key; // Watch descriptor
+	struct {
+		char *path; // Empty for the current directory
+		bool addNew; // Whether new files in here should get counted, or just the ones we know about
+	} value;
+};
+
+structdef(Watcher) {
+	Uloc *uloc;
+	LiveIndex index;
+	int inotify;
+	WatchedDir *dirs; // stb_ds hashmap
+	char **pending; // stb_ds array of paths that changed
+	char *pathBuffer;
+};
+
+static void watchDirectory(Watcher *watcher, const char *path, bool addNew, bool scanNew);
+
+static void watcherJoin(Watcher *watcher, const char *dir, const char *name) {
+	arrsetlen(watcher->pathBuffer, 0);
+	if(dir[0] != 0) {
+		appendPathComponent(&watcher->pathBuffer, cstrToString(dir), watcher->uloc->slash);
+	}
+	appendPathComponent(&watcher->pathBuffer, cstrToString(name), watcher->uloc->slash);
+	arrput(watcher->pathBuffer, 0);
+}
+
+static void watcherQueue(Watcher *watcher, const char *path) {
+	for(nat i = 0; i < arrlen(watcher->pending); i++) {
+		if(strcmp(watcher->pending[i], path) == 0) return;
+	}
+	arrput(watcher->pending, strdup(path));
+}
+
+// Watches a directory. With `scanNew` the files already in there get queued up, and directories
+// get watched too (for directories that showed up after we started)
+static void watchDirectory(Watcher *watcher, const char *path, bool addNew, bool scanNew) {
+	int wd = inotify_add_watch(watcher->inotify, path[0] != 0 ? path : ".", IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+	if(wd < 0) {
+		fprintf(stderr, "Warning: can't watch %s\n", path[0] != 0 ? path : ".");
+		return;
+	}
+	
+	nat found = hmgeti(watcher->dirs, wd);
+	if(found >= 0) {
+		watcher->dirs[found].value.addNew |= addNew;
+		return;
+	}
+	
+	WatchedDir dir = {.key = wd};
+	dir.value.path = strdup(path);
+	dir.value.addNew = addNew;
+	hmputs(watcher->dirs, dir);
+	
+	if(!scanNew) return;
+	
+	DIR *handle = opendir(path);
+	if(handle == NULL) return;
+	
+	char **subdirs = NULL;
+	struct dirent *ent;
+	while((ent = readdir(handle)) != NULL) {
+		if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+		if(!watcher->uloc->dotfiles && ent->d_name[0] == '.') continue;
+		
+		watcherJoin(watcher, path, ent->d_name);
+		DIR *sub = opendir(watcher->pathBuffer);
+		if(sub != NULL) {
+			closedir(sub);
+			arrput(subdirs, strdup(watcher->pathBuffer));
+		} else {
+			watcherQueue(watcher, watcher->pathBuffer);
+		}
+	}
+	closedir(handle);
+	
+	for(nat i = 0; i < arrlen(subdirs); i++) {
+		watchDirectory(watcher, subdirs[i], true, true);
+		free(subdirs[i]);
+	}
+	arrfree(subdirs);
+}
+
+// Counts everything that changed since the last time, and outputs the differences
+static void watcherFlush(Watcher *watcher, bool nameOnly) {
+	if(arrlen(watcher->pending) == 0) return;
+	
+	unat uniqueBefore = liveIndexUnique(&watcher->index);
+	unat linesBefore = watcher->index.lineCount;
+	bool changed = false;
+	
+	for(nat i = 0; i < arrlen(watcher->pending); i++) {
+		char *path = watcher->pending[i];
+		char *name = path + strlen(path);
+		while(name > path && name[-1] != '/' && name[-1] != '\\') name--;
+		char *shownPath = nameOnly ? name : path;
+		
+		bool known = shgeti(watcher->index.files, path) >= 0;
+		LiveFileStats previous;
+		char *errorMessage = NULL;
+		if(liveIndexUpdate(&watcher->index, watcher->uloc, path, &previous, &errorMessage)) {
+			LiveFileStats *stats = &shgetp(watcher->index.files, path)->value;
+			if(!known || stats->lineCount != previous.lineCount || stats->lineCountUnique != previous.lineCountUnique) {
+				outputLineDelta(stdout, shownPath, stats->lineCountUnique, stats->lineCount, (int8)stats->lineCountUnique - (int8)previous.lineCountUnique, (int8)stats->lineCount - (int8)previous.lineCount);
+			}
+			changed = true;
+		} else if(known) {
+			fprintf(stdout, "    %s: gone (%+lld/%+lld)\n", shownPath, -(long long)previous.lineCountUnique, -(long long)previous.lineCount);
+			changed = true;
+		}
+		
+		free(path);
+	}
+	arrsetlen(watcher->pending, 0);
+	
+	if(changed) {
+		unat unique = liveIndexUnique(&watcher->index);
+		outputLineDelta(stdout, "total", unique, watcher->index.lineCount, (int8)unique - (int8)uniqueBefore, (int8)watcher->index.lineCount - (int8)linesBefore);
+		fputc('\n', stdout);
+		fflush(stdout);
+	}
+}
+
+// Counts the files found so far, then keeps counting them again as they change
+static int watchFiles(Uloc *uloc, bool nameOnly) {
+	Watcher watcher = {
+		.uloc = uloc,
+		.inotify = inotify_init1(IN_CLOEXEC)
+	};
+	if(watcher.inotify < 0) {
+		fputs("Error: could not set up inotify\n", stderr);
+		return 1;
+	}
+	liveIndexInit(&watcher.index);
+	
+	// Directories get watched for new files too, files given by themselves just by their own
+	for(nat i = 0; i < arrlen(uloc->dirs); i++) {
+		arrsetlen(uloc->pathBuffer, 0);
+		appendDirPath(&uloc->pathBuffer, uloc->dirs, i, uloc->slash);
+		arrput(uloc->pathBuffer, 0);
+		watchDirectory(&watcher, uloc->pathBuffer, true, false);
+	}
+	
+	fputs("Unique lines:\n", stdout);
+	int status = 0;
+	for(nat i = 0; i < arrlen(uloc->files); i++) {
+		FileInfo *finfo = uloc->files + i;
+		char *path = ulocFilePath(uloc, finfo).start;
+		
+		if(finfo->parent < 0) {
+			char *dir = strdup(path);
+			char *slash = dir + finfo->entry.size - finfo->name.size;
+			*slash = 0;
+			if(slash > dir) slash[-1] = 0;
+			watchDirectory(&watcher, dir, false, false);
+			free(dir);
+		}
+		
+		LiveFileStats previous;
+		char *errorMessage = NULL;
+		if(!liveIndexUpdate(&watcher.index, uloc, path, &previous, &errorMessage)) {
+			if(errorMessage != NULL) {
+				fprintf(stderr, "Error: %s: %s\n", nameOnly ? finfo->name.start : path, errorMessage);
+				status = 1;
+			}
+			continue;
+		}
+		
+		LiveFileStats *stats = &shgetp(watcher.index.files, path)->value;
+		outputLineDefault(stdout, nameOnly ? finfo->name.start : path, stats->lineCountUnique, stats->lineCount);
+	}
+	
+	fputc('\n', stdout);
+	outputLineDefault(stdout, "total", liveIndexUnique(&watcher.index), watcher.index.lineCount);
+	fputs("\nWatching for changes...\n\n", stdout);
+	fflush(stdout);
+	
+	char events[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for(;;) {
+		ssize_t size = read(watcher.inotify, events, sizeof(events));
+		if(size <= 0) {
+			fputs("Error: could not read inotify events\n", stderr);
+			return 1;
+		}
+		
+		for(char *at = events; at < events + size;) {
+			struct inotify_event *event = (struct inotify_event*)at;
+			at += sizeof(struct inotify_event) + event->len;
+			
+			nat found = hmgeti(watcher.dirs, event->wd);
+			if(found < 0) continue;
+			
+			if(event->mask & IN_IGNORED) {
+				free(watcher.dirs[found].value.path);
+				hmdel(watcher.dirs, event->wd);
+				continue;
+			}
+			if(event->len == 0) continue;
+			
+			char *dir = watcher.dirs[found].value.path;
+			bool addNew = watcher.dirs[found].value.addNew;
+			watcherJoin(&watcher, dir, event->name);
+			
+			if(event->mask & IN_ISDIR) {
+				// Files in directories that went away get reported as gone
+				if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+					unat prefixSize = arrlen(watcher.pathBuffer) - 1;
+					for(nat i = 0; i < shlen(watcher.index.files); i++) {
+						char *path = watcher.index.files[i].key;
+						if(strncmp(path, watcher.pathBuffer, prefixSize) == 0 && (path[prefixSize] == '/' || path[prefixSize] == '\\')) {
+							watcherQueue(&watcher, path);
+						}
+					}
+				} else if(addNew && (uloc->dotfiles || event->name[0] != '.')) {
+					char *path = strdup(watcher.pathBuffer);
+					watchDirectory(&watcher, path, true, true);
+					free(path);
+				}
+				continue;
+			}
+			
+			bool known = shgeti(watcher.index.files, watcher.pathBuffer) >= 0;
+			if(known || (addNew && (uloc->dotfiles || event->name[0] != '.'))) {
+				watcherQueue(&watcher, watcher.pathBuffer);
+			}
+		}
+		
+		watcherFlush(&watcher, nameOnly);
+	}
+	
+	return status;
+}
+
+#else
+
+static int watchFiles(Uloc *uloc, bool nameOnly) {
+	fputs("Error: -watch is only supported on Linux\n", stderr);
+	return 1;
+}
+
+#endif
+
+#ifndef _WIN32
+
+// Counts everything in `path` (again) into `index`. Files that were known under `path` but aren't
+// there anymore get forgotten. Returns how many files got counted
+static unat serverScan(LiveIndex *index, Uloc *uloc, const char *path, bool forget) {
+	unat pathSize = strlen(path);
+	while(pathSize > 1 && (path[pathSize - 1] == '/' || path[pathSize - 1] == '\\')) pathSize--;
+	
+	// Leave `uloc` as empty as it was, so a long running server doesn't pile up paths
+	if(!forget) {
+		arrput(uloc->files, ((FileInfo) {
+			.entry = {
+				.size = pathSize,
+				.start = arenaCopy(&uloc->names, path, pathSize)
+			},
+			.parent = -1
+		}));
+		findFiles(uloc, 0);
+	}
+	
+	struct {char *key; bool value;} *seen = NULL;
+	sh_new_strdup(seen);
+	
+	unat counted = 0;
+	for(nat i = 0; i < arrlen(uloc->files); i++) {
+		FileInfo *finfo = uloc->files + i;
+		char *filePath = ulocFilePath(uloc, finfo).start;
+		
+		LiveFileStats previous;
+		char *errorMessage = NULL;
+		if(liveIndexUpdate(index, uloc, filePath, &previous, &errorMessage)) {
+			shput(seen, filePath, true);
+			counted++;
+		}
+	}
+	
+	char **gone = NULL;
+	for(nat i = 0; i < shlen(index->files); i++) {
+		char *known = index->files[i].key;
+		bool inside = strncmp(known, path, pathSize) == 0 && (known[pathSize] == 0 || known[pathSize] == '/' || known[pathSize] == '\\');
+		if(inside && shgeti(seen, known) < 0) arrput(gone, known);
+	}
+	for(nat i = 0; i < arrlen(gone); i++) {
+		liveIndexRemove(index, gone[i]);
+	}
+	
+	arrfree(gone);
+	shfree(seen);
+	arrsetlen(uloc->files, 0);
+	arrsetlen(uloc->dirs, 0);
+	arenaFree(&uloc->names);
+	return counted;
+}
+
+// Answers the requests of one client, one line each. Returns false when asked to shut down
+static bool serveClient(LiveIndex *index, Uloc *uloc, int client) {
+	FILE *input = fdopen(client, "r");
+	FILE *output = fdopen(dup(client), "w");
+	if(input == NULL || output == NULL) {
+		if(input != NULL) fclose(input);
+		else close(client);
+		if(output != NULL) fclose(output);
+		return true;
+	}
+	
+	bool running = true;
+	char *request = NULL;
+	size_t requestCapacity = 0;
+	ssize_t requestSize;
+	while(running && (requestSize = getline(&request, &requestCapacity, input)) > 0) {
+		while(requestSize > 0 && (request[requestSize - 1] == '\n' || request[requestSize - 1] == '\r')) requestSize--;
+		request[requestSize] = 0;
+		
+		char *argument = strchr(request, ' ');
+		if(argument != NULL) *argument++ = 0;
+		bool hasArgument = argument != NULL && argument[0] != 0;
+		
+		if(strcmp(request, "scan") == 0 || strcmp(request, "forget") == 0) {
+			if(!hasArgument) {
+				fputs("error missing path\n", output);
+			} else {
+				unat counted = serverScan(index, uloc, argument, request[0] == 'f');
+				fprintf(output, "ok %zu %zu %zu\n", counted, index->lineCount, liveIndexUnique(index));
+			}
+		} else if(strcmp(request, "file") == 0) {
+			nat found = hasArgument ? shgeti(index->files, argument) : -1;
+			if(found < 0) {
+				fputs("error not counted\n", output);
+			} else {
+				LiveFileStats *stats = &index->files[found].value;
+				fprintf(output, "ok %zu %zu\n", stats->lineCount, stats->lineCountUnique);
+			}
+		} else if(strcmp(request, "line") == 0) {
+			String line = {0};
+			if(argument != NULL) line = cstrToString(argument);
+			fprintf(output, "ok %zu\n", liveIndexLineCount(index, uloc, line));
+		} else if(strcmp(request, "total") == 0) {
+			fprintf(output, "ok %zu %zu %zu\n", (unat)shlen(index->files), index->lineCount, liveIndexUnique(index));
+		} else if(strcmp(request, "shutdown") == 0) {
+			fputs("ok\n", output);
+			running = false;
+		} else {
+			fputs("error unknown request\n", output);
+		}
+		
+		if(fflush(output) != 0) break;
+	}
+	
+	free(request);
+	fclose(input);
+	fclose(output);
+	return running;
+}
+
+// Counts `paths`, then keeps the results around and answers queries about them on a Unix socket
+static int serveQueries(Uloc *uloc, char *socketPath, char **paths) {
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	if(strlen(socketPath) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Error: socket path %s is too long\n", socketPath);
+		return 1;
+	}
+	strcpy(address.sun_path, socketPath);
+	
+	// A socket left behind by an earlier server is fine to replace, anything else isn't
+	struct stat st;
+	if(lstat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socketPath);
+	
+	int server = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(server < 0 || bind(server, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server, 16) != 0) {
+		fprintf(stderr, "Error: could not listen on %s: %s\n", socketPath, strerror(errno));
+		return 1;
+	}
+	
+	// Clients that go away in the middle of an answer shouldn't take the server with them
+	signal(SIGPIPE, SIG_IGN);
+	
+	LiveIndex index;
+	liveIndexInit(&index);
+	for(nat i = 0; i < arrlen(paths); i++) {
+		serverScan(&index, uloc, paths[i], false);
+	}
+	
+	fprintf(stderr, "Serving %zu files on %s\n", (unat)shlen(index.files), socketPath);
+	
+	for(;;) {
+		int client = accept(server, NULL, NULL);
+		if(client < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) continue;
+			fprintf(stderr, "Error: could not accept connections: %s\n", strerror(errno));
+			break;
+		}
+		
+		if(!serveClient(&index, uloc, client)) break;
+	}
+	
+	close(server);
+	unlink(socketPath);
+	liveIndexFree(&index);
+	arrfree(paths);
+	return 0;
+}
+
+#else
+
+static int serveQueries(Uloc *uloc, char *socketPath, char **paths) {
+	fputs("Error: -serve is not supported on Windows\n", stderr);
+	return 1;
+}
+
+#endif
+
+int main(int argc, char *argv[]) {
+	
+	////////////////////////////////////////
+	/// Enable UTF8 binary IO on Windows ///
+	
+	// NOTE: manifest.xml should be applied to the executable, so that argv is UTF8 rather than ASCII
+	
+	#ifdef _WIN32
+		_setmode(0, 0x8000);
+		_setmode(1, 0x8000);
+		SetConsoleCP(CP_UTF8);
+		SetConsoleOutputCP(CP_UTF8);
+	#endif
+	
+	/// Enable UTF8 binary IO on Windows ///
+	////////////////////////////////////////
+	
+	if(argc <= 1) {
+		fputs("Error: got no arguments\n\n", stderr);
+		usage(stderr);
+		return 1;
+	}
+	
+	Uloc *uloc = uloc_create();
+	assert(uloc != NULL);
+	
+	bool outputHeader = true;
+	char **stoplistFiles = NULL;
+	bool nameOnly = false;
+	char *outputFilename = NULL;
+	char *gitRepoPath = NULL;
+	char *cachePath = NULL;
+	char *sinceRevision = NULL;
+	char *comparePaths[2] = {0};
+	char *fingerprintsPath = NULL;
+	char *buildIndexPath = NULL;
+	char *queryIndexPath = NULL;
+	bool watch = false;
+	bool progress = false;
+	char *servePath = NULL;
+	double approxError = 0;
+	SortOrder sortOrder = SORT_NONE;
+	double failBelow = -1;
+	double failFileBelow = -1;
+	bool failFast = false;
+	double deadline = 0;
+	unat maxFiles = 0;
+	bool histograms = false;
+	unat topCount = 0;
+	char *sketchPath = NULL;
+	char **mergeSketchPaths = NULL;
+	unat commitCount = 1;
+	
+	OutputFormat outputFormat = OUTPUT_DEFAULT;
+	
+	////////////////////////////
+	/// CLI argument parsing ///
+	
+	bool wantOptions = true;
+	
+	for(int i = 1; i < argc; i++) {
+		String arg = cstrToString(argv[i]);
+		if(wantOptions && arg.size > 0 && arg.start[0] == '-') {
+			if(compareStrings(arg, litToString("-")) == 0) {
+				arrput(uloc->files, ((FileInfo) {
+					.entry = arg,
+					.parent = -1
+				}));
+				continue;
+			}
+			
+			if(compareStrings(arg, litToString("--")) == 0) {
+				wantOptions = false;
+				continue;
+			}
+			
+			// Tolerate double dashes
+			if(arg.size >= 2 && arg.start[1] == '-') {
+				arg.size--;
+				arg.start++;
+			}
+			
+			if(matchInsensitive(arg, litToString("-help"))) {
+				usage(stdout);
+				return 0;
+			}
+			
+			if(matchInsensitive(arg, litToString("-version"))) {
+				version(stdout);
+				return 0;
+			}
+			
+			if(matchInsensitive(arg, litToString("-all"))) {
+				uloc->dotfiles = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-fslash"))) {
+				uloc->slash = '/';
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-bslash"))) {
+				uloc->slash = '\\';
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-name"))) {
+				nameOnly = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-out")) || matchInsensitive(arg, litToString("-o"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				String file = cstrToString(argv[i]);
+				
+				if(file.size == 0) {
+					fprintf(stderr, "Error: option %s can not take an empty file name\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				outputFilename = file.start;
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-nocomments"))) {
+				uloc->stripComments = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-notrivial"))) {
+				uloc->skipTrivial = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-stoplist"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				arrput(stoplistFiles, argv[i]);
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-normalize"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its list argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(!parseNormalize(argv[i], &uloc->normalize)) {
+					fprintf(stderr, "Error: option %s got an invalid list '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-mem-limit"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its size argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(!parseSize(argv[i], &uloc->memoryLimit) || uloc->memoryLimit == 0) {
+					fprintf(stderr, "Error: option %s got an invalid size '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-git"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its repository argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				gitRepoPath = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-commits"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its count argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				char *end;
+				commitCount = strtoull(argv[i], &end, 10);
+				if(end == argv[i] || end[0] != 0 || commitCount == 0) {
+					fprintf(stderr, "Error: option %s got an invalid count '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-cache"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				cachePath = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-since"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its revision argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				sinceRevision = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-compare"))) {
+				if(i + 2 >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its old and new arguments\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				comparePaths[0] = argv[++i];
+				comparePaths[1] = argv[++i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-approx"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its error argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(!parseFraction(argv[i], &approxError) || approxError == 0 || approxError == 1) {
+					fprintf(stderr, "Error: option %s got an invalid error '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-sketch")) || matchInsensitive(arg, litToString("-merge-sketch"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(matchInsensitive(arg, litToString("-sketch"))) sketchPath = argv[i];
+				else arrput(mergeSketchPaths, argv[i]);
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-fingerprints"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				fingerprintsPath = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-build-index")) || matchInsensitive(arg, litToString("-query-index"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(matchInsensitive(arg, litToString("-build-index"))) buildIndexPath = argv[i];
+				else queryIndexPath = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-serve"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its socket path argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				servePath = argv[i];
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-sort"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its order argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(!parseSortOrder(argv[i], &sortOrder)) {
+					fprintf(stderr, "Error: option %s got an invalid order '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-top"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its count argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				char *end;
+				topCount = strtoull(argv[i], &end, 10);
+				if(end == argv[i] || end[0] != 0 || topCount == 0) {
+					fprintf(stderr, "Error: option %s got an invalid count '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
 				continue;
 			}
 			
-			if(matchInsensitive(arg, litToString("-fslash"))) {
-				slash = '/';
+			if(matchInsensitive(arg, litToString("-fail-below")) || matchInsensitive(arg, litToString("-fail-file-below"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its ratio argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				double ratio;
+				if(!parseFraction(argv[i], &ratio)) {
+					fprintf(stderr, "Error: option %s got an invalid ratio '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
+				if(matchInsensitive(arg, litToString("-fail-below"))) failBelow = ratio;
+				else failFileBelow = ratio;
 				continue;
 			}
 			
-			if(matchInsensitive(arg, litToString("-bslash"))) {
-				slash = '\\';
+			if(matchInsensitive(arg, litToString("-fail-fast"))) {
+				failFast = true;
 				continue;
 			}
 			
-			if(matchInsensitive(arg, litToString("-name"))) {
-				nameOnly = true;
+			if(matchInsensitive(arg, litToString("-deadline"))) {
+				i++;
+				if(i >= argc) {
+					fprintf(stderr, "Error: option %s did not receive its seconds argument\n\n", arg.start);
+					usage(stderr);
+					return 1;
+				}
+				
+				char *end;
+				deadline = strtod(argv[i], &end);
+				if(end == argv[i] || end[0] != 0 || !(deadline > 0)) {
+					fprintf(stderr, "Error: option %s got an invalid number of seconds '%s'\n\n", arg.start, argv[i]);
+					usage(stderr);
+					return 1;
+				}
+				
 				continue;
 			}
 			
-			if(matchInsensitive(arg, litToString("-out")) || matchInsensitive(arg, litToString("-o"))) {
+			if(matchInsensitive(arg, litToString("-max-files"))) {
 				i++;
 				if(i >= argc) {
-					fprintf(stderr, "Error: option %s did not receive its file argument\n\n", arg.start);
+					fprintf(stderr, "Error: option %s did not receive its count argument\n\n", arg.start);
 					usage(stderr);
 					return 1;
 				}
 				
-				String file = cstrToString(argv[i]);
-				
-				if(file.size == 0) {
-					fprintf(stderr, "Error: option %s can not take an empty file name\n\n", arg.start);
+				char *end;
+				maxFiles = strtoull(argv[i], &end, 10);
+				if(end == argv[i] || end[0] != 0 || maxFiles == 0) {
+					fprintf(stderr, "Error: option %s got an invalid count '%s'\n\n", arg.start, argv[i]);
 					usage(stderr);
 					return 1;
 				}
 				
-				outputFilename = file.start;
-				
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-histograms"))) {
+				histograms = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-progress"))) {
+				progress = true;
+				continue;
+			}
+			
+			if(matchInsensitive(arg, litToString("-watch"))) {
+				watch = true;
 				continue;
 			}
 			
@@ -356,133 +1931,352 @@ int main(int argc, char *argv[]) {
 		}
 		
 		FileInfo finfo = {
-			.path = arg
+			.entry = arg,
+			.parent = -1
 		};
-		arrput(files, finfo);
+		arrput(uloc->files, finfo);
 	}
 	
 	/// CLI argument parsing ///
 	////////////////////////////
 	
-	/////////////////////////////////
-	/// Find files in directories ///
+	uloc->collectFingerprints = fingerprintsPath != NULL || buildIndexPath != NULL;
 	
-	for(int i = 0; i < arrlen(files); i++) {
-		FileInfo *finfo = files + i;
-		String path = finfo->path;
+	// Stoplists are read after parsing, so that -normalize applies to them no matter the order
+	for(int i = 0; i < arrlen(stoplistFiles); i++) {
+		char *errorMessage = NULL;
+		FileData *fdata = readFile(stoplistFiles[i], &errorMessage);
+		if(errorMessage != NULL) {
+			fprintf(stderr, "Error: stoplist %s: %s\n", stoplistFiles[i], errorMessage);
+			return 1;
+		}
+		if(fdata == NULL) continue;
+		decodeText(&fdata);
 		
-		DIR *dir = opendir(path.start);
+		char *start = fdata->data;
+		char *end = fdata->data + fdata->size;
+		while(start < end) {
+			char *stop = memchr(start, '\n', end - start);
+			if(stop == NULL) stop = end;
+			addStopLine(uloc, start, stop - start);
+			start = stop + 1;
+		}
 		
-		// NOTE: If dir is NULL, it's probably not a directory.
-		// If it doesn't exist at all, we'll print a warning later.
-		if(dir != NULL) {
-			struct dirent *ent;
-			while((ent = readdir(dir)) != NULL) {
-				if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
-				
-				// I assume we can't have 0 length filenames
-				if(!dotfiles && ent->d_name[0] == '.') continue;
-				
-				unat d_namlen = strlen(ent->d_name);
-				
-				// Create new path with file name appended
-				char *newPath = malloc(path.size + d_namlen + 1 + 1);
-				char *pointer = newPath;
-				
-				memcpy(pointer, path.start, path.size);
-				pointer += path.size;
-				
-				// Avoid separating with a slash if there's already a slash there
-				if(pointer[-1] != '/' && pointer[-1] != '\\') {
-					newPath[path.size] = slash;
-					pointer++;
-				}
-				
-				memcpy(pointer, ent->d_name, d_namlen);
-				pointer += d_namlen;
-				
-				unat newPathSize = pointer - newPath;
-				newPath[newPathSize] = 0;
-				
-				String newPathString = {
-					.size = newPathSize,
-					.start = newPath
-				};
-				
-				// Add to file list. We don't know if it's a directory yet, but it'll get taken
-				// care of in the outer loop, since we're pushing this onto the end of the list.
-				arrput(files, (FileInfo) {
-					.path = newPathString
-				});
-			}
-			
-			// It's clearly not a file, so remove it
-			arrdel(files, i);
-			i--;
-			
-			closedir(dir);
+		free(fdata);
+	}
+	
+	bool approximate = approxError > 0 || sketchPath != NULL || arrlen(mergeSketchPaths) > 0;
+	if(approximate) {
+		char *conflict = NULL;
+		if(uloc->memoryLimit) conflict = "-mem-limit";
+		if(cachePath != NULL) conflict = "-cache";
+		if(comparePaths[0] != NULL) conflict = "-compare";
+		if(queryIndexPath != NULL) conflict = "-query-index";
+		if(gitRepoPath != NULL) conflict = "-git";
+		if(servePath != NULL) conflict = "-serve";
+		if(watch) conflict = "-watch";
+		
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -approx, -sketch and -merge-sketch do not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
 		}
 	}
 	
-	/// Find files in directories ///
-	/////////////////////////////////
+	if(histograms) {
+		char *conflict = NULL;
+		if(outputFormat == OUTPUT_CSV || outputFormat == OUTPUT_TSV) conflict = "-csv or -tsv";
+		if(cachePath != NULL) conflict = "-cache";
+		if(comparePaths[0] != NULL) conflict = "-compare";
+		if(queryIndexPath != NULL) conflict = "-query-index";
+		if(gitRepoPath != NULL) conflict = "-git";
+		if(servePath != NULL) conflict = "-serve";
+		if(watch) conflict = "-watch";
+		
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -histograms does not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
+		}
+	}
 	
-	////////////////////////////////////
-	/// Find file name and extension ///
+	if(failFast && failFileBelow < 0) {
+		fputs("Error: -fail-fast needs -fail-file-below\n\n", stderr);
+		usage(stderr);
+		return 1;
+	}
 	
-	for(int i = 0; i < arrlen(files); i++) {
-		FileInfo *finfo = files + i;
-		char *filepath = finfo->path.start;
-		unat pathLength = finfo->path.size;
+	if(failBelow >= 0 || failFileBelow >= 0) {
+		char *conflict = NULL;
+		if(comparePaths[0] != NULL) conflict = "-compare";
+		if(queryIndexPath != NULL) conflict = "-query-index";
+		if(gitRepoPath != NULL) conflict = "-git";
+		if(servePath != NULL) conflict = "-serve";
+		if(watch) conflict = "-watch";
 		
-		// Find filename by iterating backwards and checking for a slash/bslash
-		char *filename = filepath + pathLength - 1;
-		for(; filename >= filepath; filename--) {
-			if(filename[0] == '/' || filename[0] == '\\') {
-				break;
-			}
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -fail-below and -fail-file-below do not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
 		}
-		filename++;
+	}
+	
+	if(comparePaths[0] != NULL) {
+		char *conflict = NULL;
+		if(arrlen(uloc->files) > 0) conflict = "file arguments";
+		if(gitRepoPath != NULL) conflict = "-git";
+		if(sinceRevision != NULL) conflict = "-since";
+		if(uloc->memoryLimit) conflict = "-mem-limit";
 		
-		// Find file extension by iterating backwards and checking for a '.'
-		char *extension = filepath + pathLength - 1;
-		bool foundExtension = false;
-		for(; extension >= filename; extension--) {
-			if(extension[0] == '.') {
-				foundExtension = true;
-				break;
-			}
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -compare does not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
 		}
 		
-		if(!foundExtension) {
-			extension = NULL;
+		return compareScans(uloc, comparePaths[0], comparePaths[1], outputFormat, outputHeader, outputFilename, nameOnly);
+	}
+	
+	if(queryIndexPath != NULL) {
+		char *conflict = NULL;
+		if(arrlen(uloc->files) == 0) conflict = "no file arguments";
+		if(gitRepoPath != NULL) conflict = "-git";
+		if(sinceRevision != NULL) conflict = "-since";
+		if(buildIndexPath != NULL) conflict = "-build-index";
+		if(uloc->memoryLimit) conflict = "-mem-limit";
+		
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -query-index does not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
 		}
 		
-		finfo->name = (String) {
-			.size = strlen(filename),
-			.start = filename
-		};
+		char **paths = NULL;
+		for(int i = 0; i < arrlen(uloc->files); i++) {
+			arrput(paths, uloc->files[i].entry.start);
+		}
+		arrsetlen(uloc->files, 0);
 		
-		finfo->ext = (String) {
-			.size = extension ? strlen(extension) : 0,
-			.start = extension
-		};
+		return queryLineIndex(uloc, queryIndexPath, paths, outputFormat, outputHeader, outputFilename, nameOnly);
+	}
+	
+	// In git mode the args are revisions rather than files
+	if(gitRepoPath != NULL) {
+		if(uloc->memoryLimit || sinceRevision != NULL) {
+			fprintf(stderr, "Error: %s does not work together with -git\n\n", uloc->memoryLimit ? "-mem-limit" : "-since");
+			usage(stderr);
+			return 1;
+		}
+		
+		char **revisions = NULL;
+		for(int i = 0; i < arrlen(uloc->files); i++) {
+			arrput(revisions, uloc->files[i].entry.start);
+		}
+		if(arrlen(revisions) == 0) arrput(revisions, "HEAD");
+		arrsetlen(uloc->files, 0);
+		
+		return countGitHistory(uloc, gitRepoPath, revisions, commitCount, outputFormat, outputHeader, outputFilename);
+	}
+	
+	if(servePath != NULL) {
+		char *conflict = NULL;
+		if(outputFormat != OUTPUT_DEFAULT) conflict = "-json, -csv or -tsv";
+		if(uloc->memoryLimit) conflict = "-mem-limit";
+		if(cachePath != NULL) conflict = "-cache";
+		if(sinceRevision != NULL) conflict = "-since";
+		if(fingerprintsPath != NULL) conflict = "-fingerprints";
+		if(outputFilename != NULL) conflict = "-out";
+		if(sortOrder != SORT_NONE) conflict = "-sort";
+		if(topCount > 0) conflict = "-top";
+		if(deadline > 0) conflict = "-deadline";
+		if(maxFiles > 0) conflict = "-max-files";
+		if(buildIndexPath != NULL) conflict = "-build-index";
+		if(progress) conflict = "-progress";
+		if(watch) conflict = "-watch";
+		
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -serve does not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
+		}
+		
+		char **paths = NULL;
+		for(int i = 0; i < arrlen(uloc->files); i++) {
+			arrput(paths, uloc->files[i].entry.start);
+		}
+		arrsetlen(uloc->files, 0);
+		
+		return serveQueries(uloc, servePath, paths);
+	}
+	
+	// Without -approx, merged sketches decide the precision
+	if(approxError > 0 || (approximate && arrlen(mergeSketchPaths) == 0)) {
+		sketchInit(&uloc->sketch, sketchPrecision(approxError > 0 ? approxError : 0.01));
+	}
+	
+	for(int i = 0; i < arrlen(mergeSketchPaths); i++) {
+		Sketch merged;
+		uint8 settings, lineCount;
+		if(!loadSketch(mergeSketchPaths[i], &merged, &settings, &lineCount)) {
+			fprintf(stderr, "Error: %s is not a saved sketch\n", mergeSketchPaths[i]);
+			return 1;
+		}
+		
+		if(settings != ulocSettings(uloc)) {
+			fprintf(stderr, "Warning: %s was saved with different options, results will be off\n", mergeSketchPaths[i]);
+		}
+		
+		if(uloc->sketch.registers == NULL) {
+			uloc->sketch = merged;
+		} else if(!sketchMerge(&uloc->sketch, &merged)) {
+			fprintf(stderr, "Error: %s was saved with a different -approx error\n", mergeSketchPaths[i]);
+			return 1;
+		} else {
+			sketchFree(&merged);
+		}
+		
+		uloc->lineCount += lineCount;
+	}
+	
+	if(watch) {
+		char *conflict = NULL;
+		if(outputFormat != OUTPUT_DEFAULT) conflict = "-json, -csv or -tsv";
+		if(uloc->memoryLimit) conflict = "-mem-limit";
+		if(cachePath != NULL) conflict = "-cache";
+		if(sinceRevision != NULL) conflict = "-since";
+		if(fingerprintsPath != NULL) conflict = "-fingerprints";
+		if(outputFilename != NULL) conflict = "-out";
+		if(sortOrder != SORT_NONE) conflict = "-sort";
+		if(topCount > 0) conflict = "-top";
+		if(deadline > 0) conflict = "-deadline";
+		if(maxFiles > 0) conflict = "-max-files";
+		if(buildIndexPath != NULL) conflict = "-build-index";
+		if(progress) conflict = "-progress";
+		
+		if(conflict != NULL) {
+			fprintf(stderr, "Error: -watch does not work together with %s\n\n", conflict);
+			usage(stderr);
+			return 1;
+		}
+	}
+	
+	Histograms histogramCounts = {0};
+	if(histograms) uloc->histograms = &histogramCounts;
+	
+	double startTime = monotonicSeconds();
+	
+	// Files that got left out because of -deadline, -max-files or -fail-fast
+	nat droppedFileCount = 0;
+	
+	ProgressTicker ticker = {.uloc = uloc};
+	if(progress) startProgress(&ticker);
+	
+	/////////////////////////////////
+	/// Find files in directories ///
+	
+	findFiles(uloc, 0);
+	
+	for(int i = 0; i < arrlen(uloc->files); i++) {
+		findNameAndExtension(uloc->files + i);
 	}
 	
-	/// Find file name and extension ///
-	////////////////////////////////////
+	/// Find files in directories ///
+	/////////////////////////////////
+	
+	if(watch) return watchFiles(uloc, nameOnly);
 	
 	int status = 0;
 	
+	GitWorktree worktree;
+	bool inWorktree = (cachePath != NULL || sinceRevision != NULL) && gitWorktreeOpen(&worktree);
+	
+	// The paths of the files in the base revision, with their blob ids
+	GitIndexPath *sincePaths = NULL;
+	if(sinceRevision != NULL) {
+		if(!inWorktree) {
+			stopProgress(&ticker);
+			fputs("Error: -since only works inside of a git working tree\n", stderr);
+			return 1;
+		}
+		
+		uint1 id[GIT_ID_SIZE];
+		GitCommit commit;
+		if(!gitResolve(&worktree.repo, sinceRevision, id) || !gitReadCommit(&worktree.repo, id, &commit)) {
+			stopProgress(&ticker);
+			fprintf(stderr, "Error: could not resolve revision %s\n", sinceRevision);
+			return 1;
+		}
+		
+		char *treePath = NULL;
+		sh_new_arena(sincePaths);
+		if(!listGitTree(&worktree.repo, commit.tree, &treePath, &sincePaths, 0)) {
+			stopProgress(&ticker);
+			fprintf(stderr, "Error: could not read the tree of %s\n", sinceRevision);
+			return 1;
+		}
+		arrfree(treePath);
+	}
+	
+	BlobCache cache;
+	if(cachePath != NULL) {
+		char *errorMessage = NULL;
+		if(!blobCacheOpen(&cache, uloc, inWorktree ? &worktree : NULL, cachePath, &errorMessage)) {
+			stopProgress(&ticker);
+			fprintf(stderr, "Error: %s: %s\n", cachePath, errorMessage);
+			return 1;
+		}
+	}
+	
 	////////////////////
 	/// File reading ///
 	
-	for(int i = 0; i < arrlen(files); i++) {
-		FileInfo *finfo = files + i;
-		char *filepath = finfo->path.start;
+	atomicStore(&uloc->progress.filesFound, arrlen(uloc->files));
+	atomicStore(&uloc->progress.phase, PROGRESS_READING);
+	
+	for(int i = 0; i < arrlen(uloc->files); i++) {
+		// Past the budget the remaining files are left out, so that the totals still add up
+		if((maxFiles > 0 && (unat)i >= maxFiles) || (deadline > 0 && monotonicSeconds() - startTime >= deadline)) {
+			droppedFileCount = arrlen(uloc->files) - i;
+			dropFiles(uloc, i);
+			break;
+		}
+		
+		FileInfo *finfo = uloc->files + i;
+		char *filepath = ulocFilePath(uloc, finfo).start;
+		atomicStore(&uloc->progress.filesRead, i);
 		
 		char *errorMessage = NULL;
-		FileData *fdata = readFile(filepath, &errorMessage);
+		
+		// Archives get replaced by their members, which are read right away
+		if(isArchivePath(finfo->entry) || (finfo->parent < 0 && compareStrings(finfo->entry, litToString("-")) == 0)) {
+			char *archivePath = strdup(nameOnly ? finfo->name.start : filepath);
+			nat memberCount;
+			expandArchive(uloc, i, &memberCount, &errorMessage);
+			
+			if(errorMessage != NULL) {
+				if(status == 0) {
+					fprintf(stderr, "File errors:\n");
+					status = 1;
+				}
+				fprintf(stderr, "    %s: %s\n", archivePath, errorMessage);
+			}
+			free(archivePath);
+			
+			i += memberCount - 1;
+			atomicStore(&uloc->progress.filesFound, arrlen(uloc->files));
+			continue;
+		}
+		
+		// With a memory limit, a cache, -approx, -fail-fast or -deadline files are only read right
+		// before they get counted (if at all), so we just check that they can be opened for now
+		FileData *fdata = NULL;
+		bool readable;
+		if(uloc->memoryLimit || cachePath != NULL || approximate || failFast || deadline > 0) {
+			readable = probeFile(filepath, &errorMessage);
+		} else {
+			fdata = readFile(filepath, &errorMessage);
+			readable = fdata != NULL;
+		}
 		
 		if(errorMessage != NULL) {
 			if(status == 0) {
@@ -493,8 +2287,8 @@ int main(int argc, char *argv[]) {
 		}
 		
 		// Remove file from our list if we couldn't read it or it was empty
-		if(fdata == NULL) {
-			arrdel(files, i);
+		if(!readable) {
+			arrdel(uloc->files, i);
 			i--;
 			continue;
 		}
@@ -507,38 +2301,53 @@ int main(int argc, char *argv[]) {
 		fflush(stderr);
 	}
 	
-	if(arrlen(files) == 0) {
+	if(arrlen(uloc->files) == 0 && arrlen(mergeSketchPaths) == 0) {
+		stopProgress(&ticker);
 		fputs("Error: no files to scan\n\n", stderr);
 		usage(stderr);
 		return status;
 	}
 	
+	atomicStore(&uloc->progress.filesFound, arrlen(uloc->files));
+	atomicStore(&uloc->progress.phase, PROGRESS_COUNTING);
+	
 	/// File reading ///
 	////////////////////
 	
-	FILE *outputStream = stdout;
+	// With -since every file still gets counted for the total, but only changed ones get output
+	bool *outputFile = NULL;
+	for(int i = 0; i < arrlen(uloc->files); i++) {
+		bool changed = sincePaths == NULL || changedSince(&worktree, sincePaths, ulocFilePath(uloc, uloc->files + i).start);
+		arrput(outputFile, changed);
+	}
 	
-	if(outputFilename != NULL) {
-		outputStream = fopen(outputFilename, "wb");
-		if(outputStream == NULL) {
-			fprintf(stderr, "Error: could not open output file for writing\n");
-			return 1;
-		}
+	// Sorted files only get output once they're all counted
+	if(topCount > 0 && sortOrder == SORT_NONE) sortOrder = SORT_RATIO;
+	RankedFile *rankedFiles = NULL;
+	nat outputFileCount = 0;
+	bool failed = false;
+	
+	FILE *outputStream = openOutput(outputFilename);
+	if(outputStream == NULL) {
+		stopProgress(&ticker);
+		return 1;
 	}
 	
 	Jim jim = (Jim) {
 		.sink = outputStream,
 		.write = (Jim_Write) fwrite,
 	};
-	String *lines = NULL;
-	unat totalLineCount = 0;
 	
 	////////////////////////////////
 	/// Line counting and output ///
 	
 	switch(outputFormat) {
 		case OUTPUT_DEFAULT: {
-			fputs("Unique lines:\n", outputStream);
+			if(sinceRevision != NULL) {
+				fprintf(outputStream, "Unique lines in files changed since %s:\n", sinceRevision);
+			} else {
+				fputs("Unique lines:\n", outputStream);
+			}
 		} break;
 		case OUTPUT_CSV: {
 			if(outputHeader) {
@@ -553,112 +2362,145 @@ int main(int argc, char *argv[]) {
 		case OUTPUT_JSON: {
 			jim_object_begin(&jim);
 			
-			jim_member_key(&jim, "fileCount");
-			jim_integer(&jim, arrlen(files));
-			
 			jim_member_key(&jim, "files");
 			jim_array_begin(&jim);
 		}
 	}
 	
-	for(int i = 0; i < arrlen(files); i++) {
-		FileInfo *finfo = files + i;
-		FileData *fdata = finfo->data;
+	for(int i = 0; i < arrlen(uloc->files); i++) {
+		if(deadline > 0 && monotonicSeconds() - startTime >= deadline) {
+			droppedFileCount += arrlen(uloc->files) - i;
+			dropFiles(uloc, i);
+			break;
+		}
 		
-		// Count number of lines which are not whitespace only, and put them into the lines array
-		char *start = fdata->data;
-		char *stop = start;
-		char *end = fdata->data + fdata->size;
-		while(stop < end) {
-			String line = {
-				.start = start
-			};
-			
-			// Keep moving up `stop` until LF or EOF
-			for(; stop < end && stop[0] != '\n'; stop++) {}
-			start = stop + 1;
-			
-			for(; line.start < stop; line.start++) {
-				if(!isWhitespace(line.start[0])) {
-					break;
+		FileInfo *finfo = uloc->files + i;
+		String path = ulocFilePath(uloc, finfo);
+		
+		GitBlobKey key;
+		bool hasKey = cachePath != NULL && blobCacheKey(&cache, uloc, finfo, path.start, &key);
+		
+		if(!hasKey || !blobCacheLoad(&cache, uloc, finfo, key)) {
+			if(finfo->data == NULL) {
+				char *errorMessage = NULL;
+				finfo->data = readFile(path.start, &errorMessage);
+				if(finfo->data == NULL) {
+					fprintf(stderr, "Error: %s: %s\n", nameOnly ? finfo->name.start : path.start, errorMessage ? errorMessage : "file became empty");
+					status = 1;
+					
+					// Fingerprints of a file are found by its index
+					if(uloc->collectFingerprints) arrput(uloc->fingerprintOffsets, arrlen(uloc->fingerprints));
+					continue;
 				}
 			}
 			
-			for(; stop > line.start; stop--) {
-				if(!isWhitespace(stop[0])) {
-					break;
-				}
-			}
+			countLines(uloc, finfo);
+			if(hasKey) blobCacheStore(&cache, uloc, finfo, key);
 			
-			if(line.start < stop) {
-				line.size = stop - line.start;
-				arrput(lines, line);
-				finfo->lineCount++;
+			// The sketch has all it needs from the file
+			if(approximate) {
+				free(finfo->data);
+				finfo->data = NULL;
 			}
-			
-			stop = start;
 		}
 		
-		qsort(lines + totalLineCount, finfo->lineCount, sizeof(*lines), compareLines);
-		
-		finfo->lineCountUnique = finfo->lineCount != 0;
-		for(unat j = 1; j < finfo->lineCount; j++) {
-			String *line = lines + totalLineCount + j;
-			String *prev = line - 1;
-			if(compareStrings(*prev, *line) != 0) finfo->lineCountUnique++;
+		if(!enforceMemoryLimit(uloc, finfo)) {
+			fprintf(stderr, "Error: %s, keeping lines in memory\n", uloc->error);
+			uloc->memoryLimit = 0;
+			status = 1;
 		}
 		
-		switch(outputFormat) {
-			case OUTPUT_DEFAULT: {
-				outputLineDefault(outputStream, nameOnly ? finfo->name.start : finfo->path.start, finfo->lineCountUnique, finfo->lineCount);
-			} break;
-			case OUTPUT_CSV:
-			case OUTPUT_TSV: {
-				outputLineValues(outputStream, outputFormat, finfo);
-			} break;
-			case OUTPUT_JSON: {
-				jim_object_begin(&jim);
-					jim_member_key(&jim, "path");
-					jim_string_sized(&jim, finfo->path.start, finfo->path.size);
-					
-					jim_member_key(&jim, "name");
-					jim_string_sized(&jim, finfo->name.start, finfo->name.size);
-					
-					jim_member_key(&jim, "extension");
-					jim_string_sized(&jim, finfo->ext.start, finfo->ext.size);
-					
-					jim_member_key(&jim, "uniqueLines");
-					jim_integer(&jim, finfo->lineCountUnique);
-					
-					jim_member_key(&jim, "sourceLines");
-					jim_integer(&jim, finfo->lineCount);
-					
-					jim_member_key(&jim, "ratio");
-					jim_float(&jim, (double)finfo->lineCountUnique / finfo->lineCount, 5);
-				jim_object_end(&jim);
+		atomicStore(&uloc->progress.filesCounted, i + 1);
+		if(!outputFile[i]) continue;
+		
+		if(finfo->lineCount > 0 && (double)finfo->lineCountUnique / finfo->lineCount < failFileBelow) {
+			fprintf(stderr, "Failed: %s: unique ratio %.3f is below %.3f\n", nameOnly ? finfo->name.start : path.start, (double)finfo->lineCountUnique / finfo->lineCount, failFileBelow);
+			failed = true;
+			
+			// Only count what has been counted so far, as if the other files weren't there
+			if(failFast) {
+				droppedFileCount += arrlen(uloc->files) - (i + 1);
+				dropFiles(uloc, i + 1);
 			}
 		}
 		
-		totalLineCount += finfo->lineCount;
+		if(sortOrder == SORT_NONE) {
+			outputFileResult(outputStream, &jim, outputFormat, finfo, path, nameOnly);
+			outputFileCount++;
+		} else if(topCount > 0) {
+			keepTopFile(&rankedFiles, topCount, rankFile(uloc, i, sortOrder));
+		} else {
+			RankedFile ranked = rankFile(uloc, i, sortOrder);
+			if(ranked.path != NULL) ranked.path = strdup(ranked.path);
+			arrput(rankedFiles, ranked);
+		}
 	}
 	
+	if(rankedFiles != NULL) qsort(rankedFiles, arrlen(rankedFiles), sizeof(*rankedFiles), compareRankedFiles);
+	for(nat i = 0; i < arrlen(rankedFiles); i++) {
+		FileInfo *finfo = uloc->files + rankedFiles[i].index;
+		outputFileResult(outputStream, &jim, outputFormat, finfo, ulocFilePath(uloc, finfo), nameOnly);
+		free(rankedFiles[i].path);
+	}
+	outputFileCount += arrlen(rankedFiles);
+	arrfree(rankedFiles);
+	
 	if(outputFormat == OUTPUT_JSON) {
 		jim_array_end(&jim);
+		
+		jim_member_key(&jim, "fileCount");
+		jim_integer(&jim, outputFileCount);
+	}
+	
+	bool partial = droppedFileCount > 0;
+	if(partial) {
+		fprintf(stderr, "Stopped early, %lld of the files found did not get counted\n", (long long)droppedFileCount);
+	}
+	
+	atomicStore(&uloc->progress.phase, PROGRESS_TOTAL);
+	unat totalLineCount = uloc->lineCount;
+	unat totalLineCountUnique = countUniqueTotal(uloc);
+	stopProgress(&ticker);
+	
+	if(totalLineCount > 0 && (double)totalLineCountUnique / totalLineCount < failBelow) {
+		fprintf(stderr, "Failed: total unique ratio %.3f is below %.3f\n", (double)totalLineCountUnique / totalLineCount, failBelow);
+		failed = true;
+	}
+	
+	if(fingerprintsPath != NULL) {
+		Fingerprint *totals = fingerprintTotals(uloc, 0, arrlen(uloc->files));
+		if(!saveFingerprints(fingerprintsPath, ulocSettings(uloc), totals, arrlen(totals))) {
+			fprintf(stderr, "Error: could not write fingerprints to %s\n", fingerprintsPath);
+			status = 1;
+		}
+		arrfree(totals);
+	}
+	
+	if(sketchPath != NULL && !saveSketch(sketchPath, ulocSettings(uloc), &uloc->sketch, totalLineCount)) {
+		fprintf(stderr, "Error: could not write sketch to %s\n", sketchPath);
+		status = 1;
 	}
 	
-	qsort(lines, totalLineCount, sizeof(*lines), compareLines);
+	if(buildIndexPath != NULL && !saveLineIndex(uloc, buildIndexPath)) {
+		fprintf(stderr, "Error: could not write line index to %s\n", buildIndexPath);
+		status = 1;
+	}
 	
-	unat totalLineCountUnique = totalLineCount != 0;
-	for(unat j = 1; j < totalLineCount; j++) {
-		String *line = lines + j;
-		String *prev = line - 1;
-		if(compareStrings(*prev, *line) != 0) totalLineCountUnique++;
+	if(cachePath != NULL && !blobCacheClose(&cache)) {
+		fprintf(stderr, "Error: could not write cache file %s\n", cachePath);
+		status = 1;
 	}
 	
+	// The cache looks things up in the worktree until it's closed
+	if(inWorktree) gitWorktreeClose(&worktree);
+	shfree(sincePaths);
+	
 	switch(outputFormat) {
 		case OUTPUT_DEFAULT: {
 			fputc('\n', outputStream);
-			outputLineDefault(outputStream, "total", totalLineCountUnique, totalLineCount);
+			char *label = partial ? (approximate ? "total (partial, approximate)" : "total (partial)") : (approximate ? "total (approximate)" : "total");
+			outputLineDefault(outputStream, label, totalLineCountUnique, totalLineCount);
+			if(histograms) outputHistograms(outputStream, &jim, outputFormat, uloc->histograms);
 		} break;
 		case OUTPUT_JSON: {
 			jim_member_key(&jim, "totalUniqueLines");
@@ -667,6 +2509,21 @@ int main(int argc, char *argv[]) {
 			jim_member_key(&jim, "totalSourceLines");
 			jim_integer(&jim, totalLineCount);
 			
+			if(partial) {
+				jim_member_key(&jim, "partial");
+				jim_bool(&jim, true);
+			}
+			
+			if(approximate) {
+				jim_member_key(&jim, "approximate");
+				jim_bool(&jim, true);
+				
+				jim_member_key(&jim, "standardError");
+				jim_float(&jim, sketchError(uloc->sketch.precision), 5);
+			}
+			
+			if(histograms) outputHistograms(outputStream, &jim, outputFormat, uloc->histograms);
+			
 			jim_object_end(&jim);
 		} break;
 	}
@@ -674,12 +2531,7 @@ int main(int argc, char *argv[]) {
 	/// Line counting and output ///
 	////////////////////////////////
 	
-	if(outputStream != stdout && outputStream != stderr) {
-		if(fclose(outputStream) != 0) {
-			fprintf(stderr, "Error: could not close output file\n");
-			return 1;
-		}
-	}
+	if(closeOutput(outputStream) != 0) return 1;
 	
-	return status;
+	return failed ? 2 : status;
 }
\ No newline at end of file
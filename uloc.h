@@ -0,0 +1,5109 @@
+// uloc - unique lines of code
+//
+// This header is both the C API of uloc and its implementation. Include it as is to get the
+// declarations, and define ULOC_IMPLEMENTATION before including it in exactly one C file to get
+// the implementation as well. libuloc.c does just that for the static and shared libraries.
+//
+// A typical use looks like this:
+//
+//     Uloc *uloc = uloc_create();
+//     uloc_scanPath(uloc, "src");
+//     uloc_scanBuffer(uloc, "generated.c", buffer, bufferSize);
+//
+//     UlocFile file;
+//     for(size_t i = 0; i < uloc_fileCount(uloc); i++) {
+//         uloc_file(uloc, i, &file);
+//         printf("%s: %zu/%zu\n", file.path, file.lineCountUnique, file.lineCount);
+//     }
+//
+//     size_t lines, unique;
+//     uloc_totals(uloc, &lines, &unique);
+//     uloc_free(uloc);
+
+#ifndef ULOC_H_
+#define ULOC_H_
+
+#include <stddef.h>
+
+#define ULOC_MAJOR 0
+#define ULOC_MINOR 4
+#define ULOC_PATCH 1
+
+#if defined(__GNUC__)
+#define ULOC_API __attribute__((visibility("default")))
+#else
+#define ULOC_API
+#endif
+
+typedef struct Uloc Uloc;
+
+typedef enum UlocFlag {
+	ULOC_DOTFILES, // Don't ignore names that start with a dot when scanning directories (default 0)
+	ULOC_SLASH,    // Directory separator used when putting paths together (default is platform specific)
+	ULOC_NORMALIZE, // Combination of UlocNormalize bits, applied to lines before comparing them (default 0)
+	ULOC_STRIP_COMMENTS, // Leave out comments for file extensions with a known comment syntax (default 0)
+	ULOC_SKIP_TRIVIAL, // Leave out trivial lines like "}", "break;" or "#endif" (default 0)
+} UlocFlag;
+
+typedef enum UlocNormalize {
+	ULOC_NORMALIZE_WHITESPACE = 1 << 0, // Collapse runs of spaces and tabs inside of lines into a single space
+	ULOC_NORMALIZE_CASE       = 1 << 1, // Compare ASCII letters case insensitively
+	ULOC_NORMALIZE_SEMICOLON  = 1 << 2, // Ignore semicolons at the end of lines
+} UlocNormalize;
+
+typedef struct UlocFile {
+	const char *path;
+	const char *name;
+	const char *ext; // Including the dot, NULL if the file has no extension
+	size_t lineCount;
+	size_t lineCountUnique;
+} UlocFile;
+
+// Version of the library as "MAJOR.MINOR.PATCH"
+ULOC_API const char *uloc_version(void);
+
+// Create and destroy a scanning context. Files scanned into the same context share the totals
+ULOC_API Uloc *uloc_create(void);
+ULOC_API void uloc_free(Uloc *uloc);
+
+ULOC_API void uloc_setFlag(Uloc *uloc, UlocFlag flag, int value);
+
+// Count the lines of a buffer that is already in memory. The data gets copied, so the buffer can
+// be reused right after the call. Empty buffers are ignored, like empty files. Returns 0 on success
+ULOC_API int uloc_scanBuffer(Uloc *uloc, const char *path, const void *data, size_t size);
+
+// Count the lines of a file, or of every file inside a directory. Files that can't be read are
+// skipped and -1 is returned, with the reason available from uloc_lastError(). Returns 0 on success
+ULOC_API int uloc_scanPath(Uloc *uloc, const char *path);
+
+// Keep file data and lines held in memory under roughly `bytes` by spilling sorted runs of lines to
+// temporary files as needed (0 means no limit, which is the default). Totals stay exact
+ULOC_API void uloc_setMemoryLimit(Uloc *uloc, size_t bytes);
+
+// Leave out lines equal to `line` (after trimming and normalization) from now on, on top of the
+// trivial lines left out by ULOC_SKIP_TRIVIAL. The line gets copied
+ULOC_API void uloc_addStopLine(Uloc *uloc, const char *line, size_t size);
+
+ULOC_API const char *uloc_lastError(Uloc *uloc);
+
+// Results of the scanned files in the order they were scanned. The strings in `file` stay valid
+// until the next call to uloc_file() or until the context is freed. Returns 0 on success
+ULOC_API size_t uloc_fileCount(Uloc *uloc);
+ULOC_API int uloc_file(Uloc *uloc, size_t index, UlocFile *file);
+
+// Line counts over every file scanned so far, where lines shared between files are counted once
+ULOC_API void uloc_totals(Uloc *uloc, size_t *lineCount, size_t *lineCountUnique);
+
+#endif // ULOC_H_
+
+#ifdef ULOC_IMPLEMENTATION
+
+#define STB_DS_IMPLEMENTATION
+#include "stb_ds.h"
+
+#include <stdio.h>
+
+#include <stdint.h>
+
+#ifdef _WIN32
+
+#define MINIRENT_IMPLEMENTATION
+#include "minirent.h"
+
+#include <direct.h>
+#include <sys/stat.h>
+#define getcwd _getcwd
+
+// These are already defined in minirent.h:
+// #define WIN32_LEAN_AND_MEAN
+// #include <windows.h>
+
+#ifdef _WIN64
+#define ftello _ftelli64
+#else
+#define ftello ftell
+#endif
+
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef  int64_t  int8;
+typedef  int32_t  int4;
+typedef  int16_t  int2;
+typedef   int8_t  int1;
+typedef uint64_t uint8;
+typedef uint32_t uint4;
+typedef uint16_t uint2;
+typedef  uint8_t uint1;
+
+typedef intptr_t  nat;
+typedef   size_t unat;
+
+typedef int bool;
+#define  true 1
+#define false 0
+
+#define structdef(name) typedef struct name name; struct name
+#define enumdef(name)   typedef enum   name name; enum   name
+
+structdef(FileData) {
+	unat size;
+	char data[0];
+};
+
+structdef(String) {
+	unat size;
+	char *start;
+};
+
+#define litToString(lit) ((String){.size = sizeof(lit) - 1, .start = lit})
+static inline String cstrToString(const char *cstr) {
+	return (String){
+		.size = strlen(cstr),
+		.start = (char*)cstr
+	};
+}
+
+// Directories are kept in a flat table, where each node only stores its own name and the
+// index of its parent. Full paths are only put together when something actually needs them.
+structdef(DirNode) {
+	String name; // Entry name, or the whole argument for directories given on the command line
+	nat parent;  // Index into the directory table, -1 for roots
+};
+
+structdef(FileInfo) {
+	String entry; // Entry name, or the whole argument for files given on the command line
+	nat parent;   // Index into the directory table, -1 for roots
+	String name;
+	String ext;
+	
+	unat lineCount;
+	unat lineCountUnique;
+	
+	FileData *data;
+};
+
+// Names are copied into big blocks instead of getting an allocation each
+#define NAME_BLOCK_SIZE (64 * 1024)
+
+// Every block starts with a pointer to the previous one, so they can all be freed together
+structdef(NameArena) {
+	char *block;
+	unat used;
+	unat capacity;
+};
+
+static char *arenaCopy(NameArena *arena, const char *source, unat size) {
+	if(arena->used + size + 1 > arena->capacity) {
+		unat capacity = NAME_BLOCK_SIZE;
+		if(sizeof(char*) + size + 1 > capacity) capacity = sizeof(char*) + size + 1;
+		
+		char *block = malloc(capacity);
+		assert(block != NULL);
+		memcpy(block, &arena->block, sizeof(char*));
+		
+		arena->block = block;
+		arena->used = sizeof(char*);
+		arena->capacity = capacity;
+	}
+	
+	char *copy = arena->block + arena->used;
+	memcpy(copy, source, size);
+	copy[size] = 0;
+	arena->used += size + 1;
+	
+	return copy;
+}
+
+static void arenaFree(NameArena *arena) {
+	char *block = arena->block;
+	while(block != NULL) {
+		char *previous;
+		memcpy(&previous, block, sizeof(char*));
+		free(block);
+		block = previous;
+	}
+	*arena = (NameArena) {0};
+}
+
+static void appendPathComponent(char **buffer, String component, char slash) {
+	unat length = arrlen(*buffer);
+	
+	// Avoid separating with a slash if there's already a slash there
+	if(length > 0 && (*buffer)[length - 1] != '/' && (*buffer)[length - 1] != '\\') {
+		arrput(*buffer, slash);
+	}
+	
+	memcpy(arraddnptr(*buffer, component.size), component.start, component.size);
+}
+
+static void appendDirPath(char **buffer, DirNode *dirs, nat index, char slash) {
+	if(index < 0) return;
+	appendDirPath(buffer, dirs, dirs[index].parent, slash);
+	appendPathComponent(buffer, dirs[index].name, slash);
+}
+
+// Put together the full path of a file into `buffer` (a stb_ds array that gets reused between calls).
+// The returned string is null terminated and stays valid until the next call with the same buffer.
+static String filePath(char **buffer, DirNode *dirs, FileInfo *finfo, char slash) {
+	arrsetlen(*buffer, 0);
+	appendDirPath(buffer, dirs, finfo->parent, slash);
+	appendPathComponent(buffer, finfo->entry, slash);
+	arrput(*buffer, 0);
+	
+	return (String){
+		.size = arrlen(*buffer) - 1,
+		.start = *buffer
+	};
+}
+
+#define uloc_error(var, message) do {assert((var) != NULL); *(var) = (message); return NULL;} while(0)
+#define uloc_assert(condition, var, message) do {assert((var) != NULL); if(!(condition)) uloc_error((var), (message));} while(0)
+
+static FileData *readFile(char *path, char **errorMessage) {
+	FILE *file = fopen(path, "rb");
+	uloc_assert(file != NULL, errorMessage, "could not open file");
+	
+	// Get file size first
+	fseek(file, 0, SEEK_END);
+	unat pos = ftello(file);
+	fseek(file, 0, SEEK_SET);
+	
+	if(pos == 0) {
+		fclose(file);
+		return NULL;
+	}
+	
+	// Allocate enough memory for size + data
+	FileData *fdata = malloc(sizeof(FileData) + pos);
+	uloc_assert(fdata != NULL, errorMessage, "could not allocate memory");
+	
+	// Assign size
+	fdata->size = pos;
+	
+	// Read contents of file to memory
+	if(fread(fdata->data, pos, 1, file) != 1) {
+		free(fdata);
+		fclose(file);
+		uloc_error(errorMessage, "failed to read file");
+	}
+	
+	fclose(file);
+	
+	return fdata;
+}
+
+// Checks that a file can be opened and isn't empty, without reading it
+static bool probeFile(char *path, char **errorMessage) {
+	assert(errorMessage != NULL);
+	
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) {
+		*errorMessage = "could not open file";
+		return false;
+	}
+	
+	fseek(file, 0, SEEK_END);
+	unat pos = ftello(file);
+	fclose(file);
+	
+	return pos != 0;
+}
+
+static inline char toLower(char c) {
+	if(c >= 'A' && c <= 'Z') c += 32;
+	return c;
+}
+
+static inline bool isWhitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+//////////////////////////
+/// Line normalization ///
+
+// Normalized lines get rewritten in place inside of the file data, so no copies are made and the
+// rest of the pipeline doesn't need to know about normalization. None of the normalizations make a
+// line longer, so this is always safe. The kernels look at 8 bytes at a time (SWAR) and only drop
+// down to single bytes around whitespace.
+
+#define SWAR_ONES  0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+
+static inline uint8 loadWord(const char *pointer) {
+	uint8 word;
+	memcpy(&word, pointer, sizeof(word));
+	return word;
+}
+
+static inline void storeWord(char *pointer, uint8 word) {
+	memcpy(pointer, &word, sizeof(word));
+}
+
+// Non-zero if any byte in `word` is equal to `byte`
+static inline uint8 wordHasByte(uint8 word, uint1 byte) {
+	uint8 x = word ^ (SWAR_ONES * byte);
+	return (x - SWAR_ONES) & ~x & SWAR_HIGHS;
+}
+
+static inline bool wordHasWhitespace(uint8 word) {
+	return (wordHasByte(word, ' ') | wordHasByte(word, '\t') | wordHasByte(word, '\r')) != 0;
+}
+
+// Lowercases every ASCII letter in the word at once
+static inline uint8 wordToLower(uint8 word) {
+	uint8 heptets = word & ~SWAR_HIGHS;
+	uint8 aboveZ = heptets + SWAR_ONES * (0x80 - 'Z' - 1);
+	uint8 atLeastA = heptets + SWAR_ONES * (0x80 - 'A');
+	uint8 upper = atLeastA & ~aboveZ & ~word & SWAR_HIGHS;
+	return word | (upper >> 2);
+}
+
+static void lowerInPlace(char *start, unat size) {
+	unat i = 0;
+	for(; i + 8 <= size; i += 8) {
+		storeWord(start + i, wordToLower(loadWord(start + i)));
+	}
+	for(; i < size; i++) {
+		start[i] = toLower(start[i]);
+	}
+}
+
+// Normalizes an already trimmed line in place, returns its new size (which may be 0)
+static unat normalizeLine(char *start, unat size, int normalize) {
+	if(normalize & ULOC_NORMALIZE_SEMICOLON) {
+		while(size > 0 && (start[size - 1] == ';' || isWhitespace(start[size - 1]))) size--;
+	}
+	
+	bool lower = (normalize & ULOC_NORMALIZE_CASE) != 0;
+	
+	if(!(normalize & ULOC_NORMALIZE_WHITESPACE)) {
+		if(lower) lowerInPlace(start, size);
+		return size;
+	}
+	
+	char *read = start;
+	char *write = start;
+	char *end = start + size;
+	bool pendingSpace = false;
+	
+	while(read < end) {
+		// Whole words without whitespace just get moved down (and lowercased)
+		if(end - read >= 8) {
+			uint8 word = loadWord(read);
+			if(!wordHasWhitespace(word)) {
+				// The pending space was consumed from input that wasn't written, so `write` stays behind `read`
+				if(pendingSpace) {
+					*write++ = ' ';
+					pendingSpace = false;
+				}
+				
+				storeWord(write, lower ? wordToLower(word) : word);
+				read += 8;
+				write += 8;
+				continue;
+			}
+		}
+		
+		char c = *read++;
+		if(isWhitespace(c)) {
+			pendingSpace = true;
+			continue;
+		}
+		
+		if(pendingSpace) {
+			*write++ = ' ';
+			pendingSpace = false;
+		}
+		*write++ = lower ? toLower(c) : c;
+	}
+	
+	// Trimmed lines don't end with whitespace, so there's never a space left pending here
+	return write - start;
+}
+
+/// Line normalization ///
+//////////////////////////
+
+//////////////////////
+/// Text encodings ///
+
+// Files get turned into UTF-8 with LF line endings before they're split into lines, so the rest of
+// the pipeline only has to know about one encoding. UTF-16 is recognized by its byte order mark,
+// or without one by the zero bytes that ASCII characters have every other byte. UTF-8 byte order
+// marks get dropped, and files that only use CR line endings get their CRs turned into LFs.
+
+enumdef(TextEncoding) {
+	ENCODING_UTF8,
+	ENCODING_UTF16LE,
+	ENCODING_UTF16BE,
+};
+
+// Looks at the start of the data, `bomSize` gets the size of the byte order mark, if any
+static TextEncoding detectEncoding(const uint1 *data, unat size, unat *bomSize) {
+	*bomSize = 0;
+	if(size >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf) {
+		*bomSize = 3;
+		return ENCODING_UTF8;
+	}
+	if(size >= 2 && data[0] == 0xff && data[1] == 0xfe) {
+		*bomSize = 2;
+		return ENCODING_UTF16LE;
+	}
+	if(size >= 2 && data[0] == 0xfe && data[1] == 0xff) {
+		*bomSize = 2;
+		return ENCODING_UTF16BE;
+	}
+	
+	// Without a byte order mark, mostly Latin UTF-16 has zeros in at least half of its high bytes,
+	// and only a few in its low bytes. Real UTF-8 text files don't have zero bytes at all
+	unat sample = (size < 4096 ? size : 4096) & ~(unat)1;
+	if(sample < 4) return ENCODING_UTF8;
+	
+	unat evenZeros = 0, oddZeros = 0;
+	for(unat i = 0; i < sample; i += 2) {
+		evenZeros += data[i] == 0;
+		oddZeros += data[i + 1] == 0;
+	}
+	
+	unat units = sample / 2;
+	if(oddZeros * 2 >= units && evenZeros * 8 <= oddZeros) return ENCODING_UTF16LE;
+	if(evenZeros * 2 >= units && oddZeros * 8 <= evenZeros) return ENCODING_UTF16BE;
+	return ENCODING_UTF8;
+}
+
+static inline uint4 readUnit(const uint1 *data, bool bigEndian) {
+	return bigEndian ? (uint4)data[0] << 8 | data[1] : (uint4)data[1] << 8 | data[0];
+}
+
+// Transcodes UTF-16 into `out`, which needs room for 3 bytes per 2 bytes of input. Unpaired
+// surrogates become U+FFFD, and a trailing odd byte gets dropped. Returns the size written
+static unat utf16ToUtf8(const uint1 *data, unat size, bool bigEndian, char *out) {
+	// The high byte of 4 ASCII characters is zero, and the low byte doesn't have its high bit set.
+	// The mask is loaded like the data, so this works on any byte order
+	const uint1 maskBytes[2][8] = {
+		{0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff},
+		{0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80}
+	};
+	uint8 asciiMask = loadWord((const char*)maskBytes[bigEndian]);
+	unat low = bigEndian ? 1 : 0;
+	
+	char *write = out;
+	unat i = 0;
+	while(i + 1 < size) {
+		if(i + 8 <= size) {
+			if((loadWord((const char*)data + i) & asciiMask) == 0) {
+				write[0] = data[i + low];
+				write[1] = data[i + low + 2];
+				write[2] = data[i + low + 4];
+				write[3] = data[i + low + 6];
+				write += 4;
+				i += 8;
+				continue;
+			}
+		}
+		
+		uint4 point = readUnit(data + i, bigEndian);
+		i += 2;
+		
+		if(point >= 0xd800 && point <= 0xdfff) {
+			uint4 trail = i + 1 < size ? readUnit(data + i, bigEndian) : 0;
+			if(point <= 0xdbff && trail >= 0xdc00 && trail <= 0xdfff) {
+				point = 0x10000 + ((point - 0xd800) << 10) + (trail - 0xdc00);
+				i += 2;
+			} else {
+				point = 0xfffd;
+			}
+		}
+		
+		if(point < 0x80) {
+			*write++ = point;
+		} else if(point < 0x800) {
+			*write++ = 0xc0 | point >> 6;
+			*write++ = 0x80 | (point & 0x3f);
+		} else if(point < 0x10000) {
+			*write++ = 0xe0 | point >> 12;
+			*write++ = 0x80 | ((point >> 6) & 0x3f);
+			*write++ = 0x80 | (point & 0x3f);
+		} else {
+			*write++ = 0xf0 | point >> 18;
+			*write++ = 0x80 | ((point >> 12) & 0x3f);
+			*write++ = 0x80 | ((point >> 6) & 0x3f);
+			*write++ = 0x80 | (point & 0x3f);
+		}
+	}
+	
+	return write - out;
+}
+
+// Makes the data UTF-8 with LF line endings, in place or by replacing it with a new allocation
+static void decodeText(FileData **fdata) {
+	FileData *source = *fdata;
+	const uint1 *data = (const uint1*)source->data;
+	
+	unat bomSize;
+	TextEncoding encoding = detectEncoding(data, source->size, &bomSize);
+	
+	if(encoding != ENCODING_UTF8) {
+		unat size = source->size - bomSize;
+		FileData *decoded = malloc(sizeof(FileData) + size / 2 * 3);
+		assert(decoded != NULL);
+		decoded->size = utf16ToUtf8(data + bomSize, size, encoding == ENCODING_UTF16BE, decoded->data);
+		
+		free(source);
+		*fdata = source = decoded;
+	} else if(bomSize > 0) {
+		source->size -= bomSize;
+		memmove(source->data, source->data + bomSize, source->size);
+	}
+	
+	if(source->size > 0 && memchr(source->data, '\n', source->size) == NULL) {
+		for(char *cr = memchr(source->data, '\r', source->size); cr != NULL; cr = memchr(cr + 1, '\r', source->data + source->size - cr - 1)) {
+			*cr = '\n';
+		}
+	}
+}
+
+/// Text encodings ///
+//////////////////////
+
+static bool matchInsensitive(String a, String b) {
+	if(a.size != b.size) return false;
+	
+	for(unat i = 0; i < a.size; i++) {
+		if(toLower(a.start[i]) != toLower(b.start[i])) return false;
+	}
+	
+	return true;
+}
+
+/////////////////////////
+/// Comment stripping ///
+
+// Comment and string syntax of a family of languages. The lexer only knows about strings so that
+// comment markers inside of them are left alone, and strings are assumed to end with the line.
+structdef(CommentSyntax) {
+	const char *extensions; // Space separated, matched case insensitively
+	const char *lineComments[2];
+	const char *blockStart;
+	const char *blockEnd;
+	const char *quotes;
+	bool lineCommentAtWordStart; // Like in shells, where only a '#' that starts a word starts a comment
+};
+
+static const CommentSyntax commentSyntaxes[] = {
+	{
+		".c .h .cc .cpp .cxx .c++ .hh .hpp .hxx .h++ .inl .ipp .m .mm .java .cs .go .js .mjs .cjs .jsx .ts .tsx "
+		".kt .kts .scala .swift .dart .groovy .gradle .d .zig .glsl .hlsl .vert .frag .comp .proto .php",
+		{"//"}, "/*", "*/", "\"'`"
+	},
+	{".rs", {"//"}, "/*", "*/", "\""},
+	{".css .scss .less", {"//"}, "/*", "*/", "\"'"},
+	{".py .pyw .pyi", {"#"}, NULL, NULL, "\"'"},
+	{
+		".sh .bash .zsh .ksh .fish .rb .pl .pm .r .tcl .awk .mk .cmake .yml .yaml .toml .nim .cr .jl .ex .exs",
+		{"#"}, NULL, NULL, "\"'", true
+	},
+	{".ps1 .psm1", {"#"}, "<#", "#>", "\"'", true},
+	{".ini .conf .cfg", {";", "#"}, NULL, NULL, "\"'", true},
+	{".lua", {"--"}, "--[[", "]]", "\"'"},
+	{".sql", {"--"}, "/*", "*/", "\"'"},
+	{".hs .lhs .elm", {"--"}, "{-", "-}", "\""},
+	{".ml .mli .fs .fsi .pas .sml", {NULL}, "(*", "*)", "\""},
+	{".html .htm .xml .xhtml .svg .vue .md", {NULL}, "<!--", "-->", NULL},
+	{".lisp .lsp .cl .el .clj .cljs .scm .rkt .asm .s .inc", {";"}, NULL, NULL, "\""},
+	{".tex .sty .erl .hrl .m4", {"%"}, NULL, NULL, NULL},
+	{".f .f90 .f95 .f03 .for", {"!"}, NULL, NULL, "\"'"},
+	{".vim", {"\""}, NULL, NULL, NULL},
+	{".bat .cmd", {"::", "rem "}, NULL, NULL, NULL},
+};
+
+static const CommentSyntax *findCommentSyntax(String ext) {
+	if(ext.start == NULL) return NULL;
+	
+	for(unat i = 0; i < sizeof(commentSyntaxes) / sizeof(*commentSyntaxes); i++) {
+		const char *list = commentSyntaxes[i].extensions;
+		while(*list != 0) {
+			String candidate = {.start = (char*)list};
+			for(; list[candidate.size] != 0 && list[candidate.size] != ' '; candidate.size++) {}
+			
+			if(matchInsensitive(candidate, ext)) return commentSyntaxes + i;
+			
+			list += candidate.size;
+			if(*list == ' ') list++;
+		}
+	}
+	
+	return NULL;
+}
+
+static inline bool startsWithToken(const char *at, const char *end, const char *token) {
+	unat size = strlen(token);
+	if((unat)(end - at) < size) return false;
+	
+	String atString = {.size = size, .start = (char*)at};
+	return matchInsensitive(atString, (String){.size = size, .start = (char*)token});
+}
+
+// Fast path: a line can only hold a comment if it contains the first byte of a comment marker, and
+// memchr is quick at ruling that out for the vast majority of lines
+static bool mayHaveComment(const char *start, unat size, const CommentSyntax *syntax) {
+	const char *markers[] = {syntax->lineComments[0], syntax->lineComments[1], syntax->blockStart};
+	for(unat i = 0; i < sizeof(markers) / sizeof(*markers); i++) {
+		if(markers[i] == NULL) continue;
+		if(memchr(start, markers[i][0], size) != NULL) return true;
+		
+		// "rem" is case insensitive
+		char upper = markers[i][0] - 32;
+		if(upper >= 'A' && upper <= 'Z' && memchr(start, upper, size) != NULL) return true;
+	}
+	return false;
+}
+
+// Removes comments from a line in place and returns its new size. Block comments become a single
+// space so tokens around them don't get glued together. `inBlock` carries block comments over to the
+// following lines of the file.
+static unat stripComments(char *start, unat size, const CommentSyntax *syntax, bool *inBlock) {
+	if(!*inBlock && !mayHaveComment(start, size, syntax)) return size;
+	
+	char *read = start;
+	char *write = start;
+	char *end = start + size;
+	char quote = 0;
+	char prev = ' ';
+	
+	while(read < end) {
+		if(*inBlock) {
+			unat endSize = strlen(syntax->blockEnd);
+			for(; read < end && !startsWithToken(read, end, syntax->blockEnd); read++) {}
+			if(read == end) break;
+			
+			read += endSize;
+			*inBlock = false;
+			*write++ = ' ';
+			prev = ' ';
+			continue;
+		}
+		
+		char c = *read;
+		
+		if(quote != 0) {
+			*write++ = c;
+			read++;
+			if(c == '\\' && read < end) {
+				*write++ = *read++;
+			} else if(c == quote) {
+				quote = 0;
+			}
+			prev = c;
+			continue;
+		}
+		
+		if(syntax->quotes != NULL && c != 0 && strchr(syntax->quotes, c) != NULL) {
+			quote = c;
+			*write++ = c;
+			read++;
+			prev = c;
+			continue;
+		}
+		
+		if(syntax->blockStart != NULL && startsWithToken(read, end, syntax->blockStart)) {
+			read += strlen(syntax->blockStart);
+			*inBlock = true;
+			continue;
+		}
+		
+		bool atWordStart = !syntax->lineCommentAtWordStart || isWhitespace(prev);
+		for(unat i = 0; atWordStart && i < 2; i++) {
+			if(syntax->lineComments[i] != NULL && startsWithToken(read, end, syntax->lineComments[i])) {
+				return write - start;
+			}
+		}
+		
+		*write++ = c;
+		read++;
+		prev = c;
+	}
+	
+	return write - start;
+}
+
+/// Comment stripping ///
+/////////////////////////
+
+static inline String trimLine(String line) {
+	for(; line.size > 0 && isWhitespace(line.start[0]); line.size--) line.start++;
+	for(; line.size > 0 && isWhitespace(line.start[line.size - 1]); line.size--) {}
+	return line;
+}
+
+static inline int compareStrings(const String left, const String right) {
+	unat minSize = left.size;
+	if(right.size < minSize) minSize = right.size;
+	
+	int comparison = memcmp(left.start, right.start, minSize);
+	if(comparison == 0) {
+		if(left.size < right.size) return -1;
+		return left.size > right.size;
+	}
+	
+	return comparison;
+}
+
+////////////////
+/// Stoplist ///
+
+// Hashes a line by its size and the bytes at the start and the end, which is enough to tell
+// trivial lines apart. Non-empty lines only
+static inline uint4 stopHash(String line, uint4 seed) {
+	uint4 h = (uint1)line.start[0]
+		| (uint4)(uint1)line.start[line.size > 1 ? line.size - 2 : 0] << 8
+		| (uint4)(uint1)line.start[line.size - 1] << 16
+		| (uint4)line.size << 24;
+	
+	h ^= seed;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Built in trivial lines, placed by a perfect hash: STOP_SEED makes every line below land in its
+// own slot, and the slot indices are written out explicitly. tools/stophash.c searches for a seed
+// and prints the table (make stoptable), and checkStopTable() catches a line in the wrong slot,
+// which would otherwise just never match.
+#define STOP_SEED 0x67001437u
+#define STOP_TABLE_BITS 8
+#define STOP_MAX_SIZE 16
+
+#define STOP_LINE(lit) {.size = sizeof(lit) - 1, .start = lit}
+
+static const String stopTable[1 << STOP_TABLE_BITS] = {
+	[1] = STOP_LINE("} finally {"),
+	[2] = STOP_LINE("})"),
+	[4] = STOP_LINE("return None"),
+	[8] = STOP_LINE("<?php"),
+	[10] = STOP_LINE("break"),
+	[11] = STOP_LINE("private:"),
+	[15] = STOP_LINE("return 1;"),
+	[16] = STOP_LINE("else"),
+	[23] = STOP_LINE("end"),
+	[29] = STOP_LINE("import"),
+	[31] = STOP_LINE("then"),
+	[34] = STOP_LINE(");"),
+	[35] = STOP_LINE("protected:"),
+	[42] = STOP_LINE("return nullptr;"),
+	[52] = STOP_LINE("{"),
+	[53] = STOP_LINE("fi"),
+	[69] = STOP_LINE("break;"),
+	[80] = STOP_LINE("}else{"),
+	[88] = STOP_LINE("end function"),
+	[90] = STOP_LINE("return 0;"),
+	[91] = STOP_LINE("*/"),
+	[92] = STOP_LINE("continue;"),
+	[93] = STOP_LINE("return result;"),
+	[100] = STOP_LINE("];"),
+	[102] = STOP_LINE("public:"),
+	[110] = STOP_LINE("#else"),
+	[114] = STOP_LINE("return false;"),
+	[117] = STOP_LINE("]"),
+	[119] = STOP_LINE("begin"),
+	[123] = STOP_LINE("["),
+	[125] = STOP_LINE("pass"),
+	[126] = STOP_LINE("#endif"),
+	[127] = STOP_LINE("return -1;"),
+	[128] = STOP_LINE("end sub"),
+	[136] = STOP_LINE("} catch"),
+	[138] = STOP_LINE("continue"),
+	[141] = STOP_LINE("};"),
+	[142] = STOP_LINE("},"),
+	[143] = STOP_LINE("try {"),
+	[145] = STOP_LINE(")"),
+	[148] = STOP_LINE("{}"),
+	[153] = STOP_LINE("..."),
+	[155] = STOP_LINE("} else {"),
+	[157] = STOP_LINE("--"),
+	[159] = STOP_LINE("else {"),
+	[161] = STOP_LINE("default:"),
+	[162] = STOP_LINE("return"),
+	[168] = STOP_LINE("}"),
+	[176] = STOP_LINE("//"),
+	[177] = STOP_LINE("/*"),
+	[179] = STOP_LINE("} else"),
+	[183] = STOP_LINE("end if"),
+	[188] = STOP_LINE("esac"),
+	[193] = STOP_LINE("---"),
+	[194] = STOP_LINE("return NULL;"),
+	[197] = STOP_LINE("],"),
+	[200] = STOP_LINE("do"),
+	[213] = STOP_LINE("});"),
+	[217] = STOP_LINE("done"),
+	[227] = STOP_LINE("return;"),
+	[228] = STOP_LINE("return ret;"),
+	[230] = STOP_LINE("*"),
+	[231] = STOP_LINE("?>"),
+	[235] = STOP_LINE("#"),
+	[236] = STOP_LINE("("),
+	[238] = STOP_LINE("\"\"\""),
+	[243] = STOP_LINE("return true;"),
+	[247] = STOP_LINE("endif"),
+	[253] = STOP_LINE("end;"),
+};
+
+static void checkStopTable(void) {
+	for(unat i = 0; i < 1 << STOP_TABLE_BITS; i++) {
+		String line = stopTable[i];
+		if(line.start == NULL) continue;
+		
+		assert(line.size > 0 && line.size <= STOP_MAX_SIZE);
+		assert((stopHash(line, STOP_SEED) & ((1 << STOP_TABLE_BITS) - 1)) == i);
+	}
+}
+
+static inline bool isTrivialLine(String line) {
+	if(line.size > STOP_MAX_SIZE) return false;
+	
+	String candidate = stopTable[stopHash(line, STOP_SEED) & ((1 << STOP_TABLE_BITS) - 1)];
+	return candidate.size == line.size && memcmp(candidate.start, line.start, line.size) == 0;
+}
+
+// User supplied stop lines, in an open addressing table with linear probing
+structdef(StopSet) {
+	String *slots;
+	unat count;
+	unat capacity; // Always a power of 2, or 0
+	NameArena lines; // Owns the lines, apart from the file names which can get freed sooner
+};
+
+static bool stopSetHas(StopSet *set, String line) {
+	if(set->count == 0) return false;
+	
+	unat mask = set->capacity - 1;
+	for(unat i = stopHash(line, 0) & mask; set->slots[i].start != NULL; i = (i + 1) & mask) {
+		if(compareStrings(set->slots[i], line) == 0) return true;
+	}
+	return false;
+}
+
+static void stopSetInsert(StopSet *set, String line) {
+	unat mask = set->capacity - 1;
+	unat i = stopHash(line, 0) & mask;
+	for(; set->slots[i].start != NULL; i = (i + 1) & mask) {}
+	set->slots[i] = line;
+	set->count++;
+}
+
+static void stopSetAdd(StopSet *set, String line) {
+	if(line.size == 0 || stopSetHas(set, line)) return;
+	
+	// Keep the table at most half full
+	if((set->count + 1) * 2 > set->capacity) {
+		StopSet grown = {
+			.capacity = set->capacity ? set->capacity * 2 : 64,
+			.lines = set->lines
+		};
+		grown.slots = calloc(grown.capacity, sizeof(String));
+		assert(grown.slots != NULL);
+		
+		for(unat i = 0; i < set->capacity; i++) {
+			if(set->slots[i].start != NULL) stopSetInsert(&grown, set->slots[i]);
+		}
+		
+		free(set->slots);
+		*set = grown;
+	}
+	
+	stopSetInsert(set, line);
+}
+
+/// Stoplist ///
+////////////////
+
+// Lines are sorted with a multikey quicksort (Bentley & Sedgewick): partition on a single byte
+// at `depth`, and only move to the next byte for lines that are equal so far. This way shared
+// prefixes are only looked at once per partitioning step instead of once per comparison.
+
+// Buckets smaller than this get insertion sorted instead
+#define LINE_SORT_CUTOFF 16
+
+// Byte at `depth`, or -1 past the end, so that shorter lines come first like in compareStrings()
+static inline int lineByte(String line, unat depth) {
+	return depth < line.size ? (uint1)line.start[depth] : -1;
+}
+
+// Same as compareStrings(), but assumes the first `depth` bytes are already known to be equal
+static inline int compareStringsFrom(String left, String right, unat depth) {
+	left.start += depth;
+	left.size -= depth;
+	right.start += depth;
+	right.size -= depth;
+	return compareStrings(left, right);
+}
+
+static void insertionSortLines(String *lines, unat count, unat depth) {
+	for(unat i = 1; i < count; i++) {
+		String line = lines[i];
+		unat j = i;
+		for(; j > 0 && compareStringsFrom(lines[j - 1], line, depth) > 0; j--) {
+			lines[j] = lines[j - 1];
+		}
+		lines[j] = line;
+	}
+}
+
+static inline int medianOfThree(int a, int b, int c) {
+	if(a < b) {
+		if(b < c) return b;
+		return a < c ? c : a;
+	}
+	if(a < c) return a;
+	return b < c ? c : b;
+}
+
+static inline void swapLines(String *a, String *b) {
+	String tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void sortLinesFrom(String *lines, unat count, unat depth) {
+	while(count > LINE_SORT_CUTOFF) {
+		int pivot = medianOfThree(
+			lineByte(lines[0], depth),
+			lineByte(lines[count / 2], depth),
+			lineByte(lines[count - 1], depth)
+		);
+		
+		// Three way partition: [0, lt) < pivot, [lt, gt) == pivot, [gt, count) > pivot
+		unat lt = 0, i = 0, gt = count;
+		while(i < gt) {
+			int byte = lineByte(lines[i], depth);
+			if(byte < pivot) {
+				swapLines(lines + lt, lines + i);
+				lt++;
+				i++;
+			} else if(byte > pivot) {
+				gt--;
+				swapLines(lines + gt, lines + i);
+			} else {
+				i++;
+			}
+		}
+		
+		// Lines in the middle bucket all ended here when the pivot is past their end, so they're equal
+		String *less = lines, *equal = lines + lt, *greater = lines + gt;
+		unat lessCount = lt, equalCount = pivot < 0 ? 0 : gt - lt, greaterCount = count - gt;
+		
+		// Recurse into the two smaller buckets and keep going with the biggest one, so each call
+		// deeper gets at most half the lines and the stack stays within log2(count) frames
+		if(equalCount >= lessCount && equalCount >= greaterCount) {
+			sortLinesFrom(less, lessCount, depth);
+			sortLinesFrom(greater, greaterCount, depth);
+			lines = equal;
+			count = equalCount;
+			depth++;
+		} else if(lessCount >= greaterCount) {
+			sortLinesFrom(equal, equalCount, depth + 1);
+			sortLinesFrom(greater, greaterCount, depth);
+			lines = less;
+			count = lessCount;
+		} else {
+			sortLinesFrom(less, lessCount, depth);
+			sortLinesFrom(equal, equalCount, depth + 1);
+			lines = greater;
+			count = greaterCount;
+		}
+	}
+	
+	insertionSortLines(lines, count, depth);
+}
+
+static inline void sortLines(String *lines, unat count) {
+	sortLinesFrom(lines, count, 0);
+}
+
+// Removes repeated lines from a sorted run in place, returns the number of lines left
+static unat dedupLines(String *lines, unat count) {
+	if(count == 0) return 0;
+	
+	unat unique = 1;
+	for(unat j = 1; j < count; j++) {
+		if(compareStrings(lines[unique - 1], lines[j]) != 0) lines[unique++] = lines[j];
+	}
+	
+	return unique;
+}
+
+// A sorted run of unique lines, consumed from the front while merging
+structdef(LineRun) {
+	String *lines;
+	unat count;
+	
+	// Runs that got spilled to a temporary file are read back one line at a time. Lines are read
+	// into three buffers in turn, so the last two lines taken out of the run are still valid, which
+	// is what comparing against the previous line while merging needs
+	FILE *spill;
+	String line;
+	char *buffers[3];
+	int currentBuffer;
+};
+
+// Spilled runs are stored as a sequence of [unat size][size bytes] records
+static bool writeSpilledLine(FILE *spill, String line) {
+	if(fwrite(&line.size, sizeof(line.size), 1, spill) != 1) return false;
+	return line.size == 0 || fwrite(line.start, line.size, 1, spill) == 1;
+}
+
+static void runAdvance(LineRun *run) {
+	if(run->spill == NULL) {
+		run->lines++;
+		run->count--;
+		return;
+	}
+	
+	unat size;
+	if(fread(&size, sizeof(size), 1, run->spill) != 1) {
+		run->count = 0;
+		return;
+	}
+	
+	run->currentBuffer = (run->currentBuffer + 1) % 3;
+	char **buffer = run->buffers + run->currentBuffer;
+	arrsetlen(*buffer, size);
+	
+	if(size > 0 && fread(*buffer, size, 1, run->spill) != 1) {
+		run->count = 0;
+		return;
+	}
+	
+	run->line = (String) {
+		.size = size,
+		.start = *buffer
+	};
+	run->lines = &run->line;
+	run->count = 1;
+}
+
+static void runOpenSpill(LineRun *run, FILE *spill) {
+	*run = (LineRun) {
+		.spill = spill
+	};
+	rewind(spill);
+	runAdvance(run);
+}
+
+static void runFree(LineRun *run) {
+	arrfree(run->buffers[0]);
+	arrfree(run->buffers[1]);
+	arrfree(run->buffers[2]);
+}
+
+// K-way merge of sorted runs using a loser tree. Internal nodes 1..k-1 hold the run that lost
+// the match at that node, and node 0 holds the overall winner, so taking a line only replays
+// the matches on the path from that run's leaf to the root (log2(k) comparisons).
+structdef(LineMerger) {
+	LineRun *runs;
+	nat runCount;
+	nat *tree;
+};
+
+// Does run `a` come before run `b`? Exhausted runs lose against everything
+static inline bool runBeats(LineMerger *merger, nat a, nat b) {
+	LineRun *left = merger->runs + a;
+	LineRun *right = merger->runs + b;
+	if(left->count == 0) return false;
+	if(right->count == 0) return true;
+	
+	int comparison = compareStrings(left->lines[0], right->lines[0]);
+	if(comparison != 0) return comparison < 0;
+	return a < b;
+}
+
+static void mergerInit(LineMerger *merger, LineRun *runs, nat runCount) {
+	merger->runs = runs;
+	merger->runCount = runCount;
+	merger->tree = malloc(sizeof(*merger->tree) * (runCount > 0 ? runCount : 1));
+	assert(merger->tree != NULL);
+	merger->tree[0] = 0;
+	
+	if(runCount <= 1) return;
+	
+	// Play the initial tournament bottom-up, leaves for runs sit at runCount + run
+	nat *winners = malloc(sizeof(*winners) * runCount * 2);
+	assert(winners != NULL);
+	
+	for(nat r = 0; r < runCount; r++) winners[runCount + r] = r;
+	
+	for(nat node = runCount - 1; node >= 1; node--) {
+		nat left = winners[node * 2];
+		nat right = winners[node * 2 + 1];
+		if(runBeats(merger, left, right)) {
+			winners[node] = left;
+			merger->tree[node] = right;
+		} else {
+			winners[node] = right;
+			merger->tree[node] = left;
+		}
+	}
+	
+	merger->tree[0] = winners[1];
+	free(winners);
+}
+
+// Takes the smallest line out of all the runs, returns false once every run is exhausted
+static bool mergerNext(LineMerger *merger, String *line) {
+	if(merger->runCount == 0) return false;
+	
+	nat winner = merger->tree[0];
+	LineRun *run = merger->runs + winner;
+	if(run->count == 0) return false;
+	
+	*line = run->lines[0];
+	runAdvance(run);
+	
+	// Replay the matches from the winner's leaf up to the root
+	for(nat node = (merger->runCount + winner) / 2; node >= 1; node /= 2) {
+		if(runBeats(merger, merger->tree[node], winner)) {
+			nat loser = winner;
+			winner = merger->tree[node];
+			merger->tree[node] = loser;
+		}
+	}
+	merger->tree[0] = winner;
+	
+	return true;
+}
+
+static void mergerFree(LineMerger *merger) {
+	free(merger->tree);
+	merger->tree = NULL;
+}
+
+///////////////
+/// Inflate ///
+
+// A self-contained decoder for deflate streams (RFC 1951) and their zlib wrapping (RFC 1950).
+// The whole output is kept in one growing buffer, which doubles as the window for back references.
+// Huffman codes up to INFLATE_FAST_BITS long get decoded with a single table lookup, longer ones
+// fall back to walking the canonical code one bit at a time.
+
+#define INFLATE_FAST_BITS 9
+#define INFLATE_BUFFER_SIZE (64 * 1024)
+
+structdef(Huffman) {
+	uint2 counts[16];
+	uint2 symbols[288];
+	uint2 fast[1 << INFLATE_FAST_BITS]; // (length << 9) | symbol, 0 for codes longer than INFLATE_FAST_BITS
+};
+
+structdef(Inflater) {
+	const uint1 *in;
+	unat inSize;
+	unat inPos;
+	
+	// When reading from a file, `in` is `buffer`, which gets refilled from it
+	FILE *file;
+	uint1 *buffer;
+	
+	uint8 bits;
+	int bitCount;
+	unat padding; // Zero bytes fed in after the end of the input
+	
+	char *out; // stb_ds array
+	
+	// When set, output goes into `target` instead, and can't grow past `targetCapacity`
+	FileData *target;
+	unat targetCapacity;
+};
+
+static inline unat inflateOutSize(Inflater *inf) {
+	return inf->target != NULL ? inf->target->size : (unat)arrlen(inf->out);
+}
+
+// Room for `size` more bytes of output, or NULL if a target is full
+static inline char *inflateOutput(Inflater *inf, unat size) {
+	if(inf->target == NULL) return arraddnptr(inf->out, size);
+	if(inf->targetCapacity - inf->target->size < size) return NULL;
+	
+	char *to = inf->target->data + inf->target->size;
+	inf->target->size += size;
+	return to;
+}
+
+static const uint2 inflateLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint1 inflateLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint2 inflateDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint1 inflateDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static bool inflateFill(Inflater *inf) {
+	if(inf->file == NULL) return false;
+	inf->inSize = fread(inf->buffer, 1, INFLATE_BUFFER_SIZE, inf->file);
+	inf->in = inf->buffer;
+	inf->inPos = 0;
+	return inf->inSize > 0;
+}
+
+// Keeps at least 57 bits in the buffer. Past the end of the input zeros get fed in, which is
+// checked for once the stream is done
+static inline void inflateRefill(Inflater *inf) {
+	while(inf->bitCount <= 56) {
+		uint8 byte = 0;
+		if(inf->inPos < inf->inSize || inflateFill(inf)) {
+			byte = inf->in[inf->inPos++];
+		} else {
+			inf->padding++;
+		}
+		inf->bits |= byte << inf->bitCount;
+		inf->bitCount += 8;
+	}
+}
+
+static inline uint4 inflateBits(Inflater *inf, int count) {
+	if(count == 0) return 0;
+	inflateRefill(inf);
+	uint4 value = inf->bits & ((1ull << count) - 1);
+	inf->bits >>= count;
+	inf->bitCount -= count;
+	return value;
+}
+
+// Did decoding read further than the input goes?
+static inline bool inflateOverrun(Inflater *inf) {
+	return (unat)inf->bitCount < inf->padding * 8;
+}
+
+static bool buildHuffman(Huffman *huffman, const uint1 *lengths, int count) {
+	memset(huffman->counts, 0, sizeof(huffman->counts));
+	for(int i = 0; i < count; i++) huffman->counts[lengths[i]]++;
+	huffman->counts[0] = 0;
+	
+	// Reject over-subscribed codes, incomplete ones are fine (a single distance code is allowed)
+	int left = 1;
+	for(int length = 1; length < 16; length++) {
+		left = (left << 1) - huffman->counts[length];
+		if(left < 0) return false;
+	}
+	
+	uint2 offsets[16];
+	offsets[1] = 0;
+	for(int length = 1; length < 15; length++) offsets[length + 1] = offsets[length] + huffman->counts[length];
+	
+	for(int symbol = 0; symbol < count; symbol++) {
+		if(lengths[symbol] != 0) huffman->symbols[offsets[lengths[symbol]]++] = symbol;
+	}
+	
+	// Canonical codes are handed out in order of (length, symbol), the bit reader sees them reversed
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+	uint4 code = 0;
+	int index = 0;
+	for(int length = 1; length <= INFLATE_FAST_BITS; length++) {
+		for(int i = 0; i < huffman->counts[length]; i++, code++) {
+			uint4 reversed = 0;
+			for(int bit = 0; bit < length; bit++) reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+			
+			uint2 entry = length << 9 | huffman->symbols[index++];
+			for(uint4 slot = reversed; slot < (1 << INFLATE_FAST_BITS); slot += 1 << length) {
+				huffman->fast[slot] = entry;
+			}
+		}
+		code <<= 1;
+	}
+	
+	return true;
+}
+
+static int decodeSymbol(Inflater *inf, Huffman *huffman) {
+	inflateRefill(inf);
+	uint2 entry = huffman->fast[inf->bits & ((1 << INFLATE_FAST_BITS) - 1)];
+	if(entry != 0) {
+		inflateBits(inf, entry >> 9);
+		return entry & 511;
+	}
+	
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for(int length = 1; length < 16; length++) {
+		code |= inflateBits(inf, 1);
+		int count = huffman->counts[length];
+		if(code - count < first) return huffman->symbols[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	
+	return -1;
+}
+
+static bool inflateCodes(Inflater *inf, Huffman *lengthCodes, Huffman *distCodes) {
+	for(;;) {
+		int symbol = decodeSymbol(inf, lengthCodes);
+		if(symbol < 0 || inf->padding > 16) return false;
+		
+		if(symbol < 256) {
+			char *to = inflateOutput(inf, 1);
+			if(to == NULL) return false;
+			*to = symbol;
+			continue;
+		}
+		
+		if(symbol == 256) return true;
+		
+		symbol -= 257;
+		if(symbol >= 29) return false;
+		unat length = inflateLengthBase[symbol] + inflateBits(inf, inflateLengthExtra[symbol]);
+		
+		int distSymbol = decodeSymbol(inf, distCodes);
+		if(distSymbol < 0 || distSymbol >= 30) return false;
+		unat dist = inflateDistBase[distSymbol] + inflateBits(inf, inflateDistExtra[distSymbol]);
+		
+		if(dist > inflateOutSize(inf)) return false;
+		
+		// Copies can overlap with their own output, so go byte by byte
+		char *to = inflateOutput(inf, length);
+		if(to == NULL) return false;
+		char *from = to - dist;
+		for(unat i = 0; i < length; i++) to[i] = from[i];
+	}
+}
+
+static bool inflateStored(Inflater *inf) {
+	// Stored blocks start at a byte boundary
+	inflateBits(inf, inf->bitCount & 7);
+	unat length = inflateBits(inf, 16);
+	unat inverted = inflateBits(inf, 16);
+	if((length ^ 0xffff) != inverted) return false;
+	
+	// Take whole bytes from the bit buffer first, then straight from the input
+	for(; length > 0 && inf->bitCount >= 8; length--) {
+		char *to = inflateOutput(inf, 1);
+		if(to == NULL) return false;
+		*to = inflateBits(inf, 8);
+	}
+	
+	while(length > 0) {
+		if(inf->inPos == inf->inSize && !inflateFill(inf)) return false;
+		
+		unat chunk = inf->inSize - inf->inPos;
+		if(chunk > length) chunk = length;
+		char *to = inflateOutput(inf, chunk);
+		if(to == NULL) return false;
+		memcpy(to, inf->in + inf->inPos, chunk);
+		inf->inPos += chunk;
+		length -= chunk;
+	}
+	
+	return true;
+}
+
+static Huffman fixedLengthCodes, fixedDistCodes;
+
+// Gets called before decoding on several threads, so that they don't race to build these
+static void buildFixedHuffman(void) {
+	static bool built = false;
+	if(built) return;
+	
+	uint1 lengths[288];
+	int i = 0;
+	for(; i < 144; i++) lengths[i] = 8;
+	for(; i < 256; i++) lengths[i] = 9;
+	for(; i < 280; i++) lengths[i] = 7;
+	for(; i < 288; i++) lengths[i] = 8;
+	buildHuffman(&fixedLengthCodes, lengths, 288);
+	
+	for(i = 0; i < 30; i++) lengths[i] = 5;
+	buildHuffman(&fixedDistCodes, lengths, 30);
+	built = true;
+}
+
+static bool inflateFixed(Inflater *inf) {
+	buildFixedHuffman();
+	return inflateCodes(inf, &fixedLengthCodes, &fixedDistCodes);
+}
+
+static bool inflateDynamic(Inflater *inf) {
+	static const uint1 order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+	
+	int lengthCount = inflateBits(inf, 5) + 257;
+	int distCount = inflateBits(inf, 5) + 1;
+	int codeCount = inflateBits(inf, 4) + 4;
+	if(lengthCount > 286 || distCount > 30) return false;
+	
+	uint1 lengths[288 + 32] = {0};
+	for(int i = 0; i < codeCount; i++) lengths[order[i]] = inflateBits(inf, 3);
+	
+	Huffman codeCodes;
+	if(!buildHuffman(&codeCodes, lengths, 19)) return false;
+	
+	// Code lengths for both alphabets come as one sequence, with run length encoding
+	memset(lengths, 0, sizeof(lengths));
+	for(int i = 0; i < lengthCount + distCount;) {
+		int symbol = decodeSymbol(inf, &codeCodes);
+		if(symbol < 0) return false;
+		
+		if(symbol < 16) {
+			lengths[i++] = symbol;
+			continue;
+		}
+		
+		uint1 repeated = 0;
+		int repeat;
+		if(symbol == 16) {
+			if(i == 0) return false;
+			repeated = lengths[i - 1];
+			repeat = 3 + inflateBits(inf, 2);
+		} else if(symbol == 17) {
+			repeat = 3 + inflateBits(inf, 3);
+		} else {
+			repeat = 11 + inflateBits(inf, 7);
+		}
+		
+		if(i + repeat > lengthCount + distCount) return false;
+		while(repeat-- > 0) lengths[i++] = repeated;
+	}
+	
+	if(lengths[256] == 0) return false;
+	
+	Huffman lengthCodes, distCodes;
+	if(!buildHuffman(&lengthCodes, lengths, lengthCount)) return false;
+	if(!buildHuffman(&distCodes, lengths + lengthCount, distCount)) return false;
+	
+	return inflateCodes(inf, &lengthCodes, &distCodes);
+}
+
+// Decodes one block of a raw deflate stream, appending to `inf->out`
+static bool inflateBlock(Inflater *inf, bool *last) {
+	*last = inflateBits(inf, 1);
+	
+	bool ok = false;
+	switch(inflateBits(inf, 2)) {
+		case 0: ok = inflateStored(inf); break;
+		case 1: ok = inflateFixed(inf); break;
+		case 2: ok = inflateDynamic(inf); break;
+	}
+	
+	return ok && !inflateOverrun(inf);
+}
+
+// Decodes a whole raw deflate stream, appending to `inf->out`
+static bool inflateRaw(Inflater *inf) {
+	bool last = false;
+	while(!last) {
+		if(!inflateBlock(inf, &last)) return false;
+	}
+	
+	return true;
+}
+
+// Deflate can't expand data by more than about 1032 times, so no more than this can come out of
+// `size` bytes of it
+static inline unat maxInflatedSize(unat size) {
+	return size * 1032 + 64;
+}
+
+// Decodes a zlib stream from memory into a new stb_ds array. `expectedSize` is only a hint used to
+// size the output up front, and gets limited so bad hints can't cause huge allocations. Returns NULL
+// if the stream is broken
+static char *inflateZlib(const uint1 *in, unat inSize, unat expectedSize) {
+	if(inSize < 2 || (in[0] & 0x0f) != 8 || (in[0] << 8 | in[1]) % 31 != 0 || (in[1] & 0x20) != 0) return NULL;
+	
+	Inflater inf = {
+		.in = in + 2,
+		.inSize = inSize - 2
+	};
+	
+	unat capacity = expectedSize > 0 ? expectedSize : 4096;
+	if(capacity > maxInflatedSize(inSize)) capacity = maxInflatedSize(inSize);
+	if(capacity > 64 * 1024 * 1024) capacity = 64 * 1024 * 1024;
+	arrsetcap(inf.out, capacity);
+	
+	if(!inflateRaw(&inf)) {
+		arrfree(inf.out);
+		return NULL;
+	}
+	
+	// The adler32 checksum after the stream is not checked
+	return inf.out;
+}
+
+/// Inflate ///
+///////////////
+
+/////////////////////
+/// Input streams ///
+
+// Reads files front to back through a fixed size buffer, and transparently decompresses gzip
+// (RFC 1952, including several members one after the other). Decompressed data is handed out one
+// deflate block at a time, keeping only the last 32K around for back references, so memory stays
+// bounded no matter how big the stream is.
+
+#define INFLATE_WINDOW_SIZE (32 * 1024)
+
+structdef(InputStream) {
+	Inflater inf;
+	bool gzip;
+	unat outPos; // How much of `inf.out` was handed out already
+	uint4 crc;
+	uint4 memberSize;
+	bool ended;
+	bool failed;
+};
+
+static uint4 crc32Table[256];
+
+static void crc32Init(void) {
+	static bool ready = false;
+	if(ready) return;
+	
+	for(uint4 i = 0; i < 256; i++) {
+		uint4 crc = i;
+		for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		crc32Table[i] = crc;
+	}
+	ready = true;
+}
+
+static uint4 crc32Update(uint4 crc, const uint1 *data, unat size) {
+	crc = ~crc;
+	for(unat i = 0; i < size; i++) crc = crc32Table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+// Are there bytes left that aren't padding? Only makes sense at a byte boundary
+static bool inflateHasInput(Inflater *inf) {
+	inflateRefill(inf);
+	return (unat)inf->bitCount > inf->padding * 8;
+}
+
+static bool readGzipHeader(Inflater *inf) {
+	uint4 id1 = inflateBits(inf, 8);
+	uint4 id2 = inflateBits(inf, 8);
+	uint4 method = inflateBits(inf, 8);
+	uint4 flags = inflateBits(inf, 8);
+	if(id1 != 0x1f || id2 != 0x8b || method != 8 || (flags & 0xe0)) return false;
+	
+	// Modification time, extra flags and OS
+	inflateBits(inf, 32);
+	inflateBits(inf, 16);
+	
+	if(flags & 4) {
+		unat extraSize = inflateBits(inf, 16);
+		for(unat i = 0; i < extraSize && !inflateOverrun(inf); i++) inflateBits(inf, 8);
+	}
+	
+	// File name and comment are NUL terminated
+	for(uint4 flag = 8; flag <= 16; flag <<= 1) {
+		if(!(flags & flag)) continue;
+		while(inflateBits(inf, 8) != 0 && !inflateOverrun(inf)) {}
+	}
+	
+	if(flags & 2) inflateBits(inf, 16);
+	return !inflateOverrun(inf);
+}
+
+// Starts reading `file`, which gets decompressed if it starts like gzip does
+static void inputOpen(InputStream *stream, FILE *file) {
+	crc32Init();
+	
+	*stream = (InputStream) {0};
+	stream->inf.file = file;
+	stream->inf.buffer = malloc(INFLATE_BUFFER_SIZE);
+	assert(stream->inf.buffer != NULL);
+	inflateFill(&stream->inf);
+	
+	const uint1 *in = stream->inf.in;
+	stream->gzip = stream->inf.inSize >= 3 && in[0] == 0x1f && in[1] == 0x8b && in[2] == 8;
+	if(stream->gzip) {
+		arrsetcap(stream->inf.out, 4 * INFLATE_WINDOW_SIZE);
+		stream->failed = !readGzipHeader(&stream->inf);
+		stream->ended = stream->failed;
+	}
+}
+
+static void inputClose(InputStream *stream) {
+	free(stream->inf.buffer);
+	arrfree(stream->inf.out);
+}
+
+// Decodes the next deflate block, and when it was the last one of a gzip member checks the
+// trailer and moves on to the next member
+static bool inputInflate(InputStream *stream) {
+	Inflater *inf = &stream->inf;
+	
+	// Drop what was handed out already, except for the window
+	if(stream->outPos > 2 * INFLATE_WINDOW_SIZE) {
+		unat keep = arrlen(inf->out) - stream->outPos + INFLATE_WINDOW_SIZE;
+		memmove(inf->out, inf->out + stream->outPos - INFLATE_WINDOW_SIZE, keep);
+		arrsetlen(inf->out, keep);
+		stream->outPos = INFLATE_WINDOW_SIZE;
+	}
+	
+	unat outSize = arrlen(inf->out);
+	bool last;
+	if(!inflateBlock(inf, &last)) return false;
+	
+	unat produced = arrlen(inf->out) - outSize;
+	stream->crc = crc32Update(stream->crc, (const uint1*)inf->out + outSize, produced);
+	stream->memberSize += produced;
+	if(!last) return true;
+	
+	// The trailer is the CRC-32 and size of the member, at a byte boundary
+	inflateBits(inf, inf->bitCount & 7);
+	uint4 crc = inflateBits(inf, 16);
+	crc |= inflateBits(inf, 16) << 16;
+	uint4 size = inflateBits(inf, 16);
+	size |= inflateBits(inf, 16) << 16;
+	if(inflateOverrun(inf) || crc != stream->crc || size != stream->memberSize) return false;
+	
+	stream->crc = 0;
+	stream->memberSize = 0;
+	if(!inflateHasInput(inf)) {
+		stream->ended = true;
+		return true;
+	}
+	
+	// Some files end in zeros instead of another member, which gzip accepts too
+	uint4 next = inf->bits & 0xffff;
+	if(next == 0) {
+		stream->ended = true;
+		return true;
+	}
+	
+	// The window doesn't reach back into the previous member
+	arrdeln(inf->out, 0, stream->outPos);
+	stream->outPos = 0;
+	return readGzipHeader(inf);
+}
+
+// Reads up to `size` bytes, less only at the end or when something went wrong
+static unat inputRead(InputStream *stream, void *buffer, unat size) {
+	Inflater *inf = &stream->inf;
+	uint1 *to = buffer;
+	unat done = 0;
+	
+	if(!stream->gzip) {
+		while(done < size) {
+			if(inf->inPos == inf->inSize && !inflateFill(inf)) break;
+			unat chunk = inf->inSize - inf->inPos;
+			if(chunk > size - done) chunk = size - done;
+			memcpy(to + done, inf->in + inf->inPos, chunk);
+			inf->inPos += chunk;
+			done += chunk;
+		}
+		return done;
+	}
+	
+	while(done < size) {
+		unat available = arrlen(inf->out) - stream->outPos;
+		if(available > 0) {
+			unat chunk = available < size - done ? available : size - done;
+			memcpy(to + done, inf->out + stream->outPos, chunk);
+			stream->outPos += chunk;
+			done += chunk;
+			continue;
+		}
+		
+		if(stream->ended) break;
+		if(!inputInflate(stream)) {
+			stream->failed = true;
+			stream->ended = true;
+		}
+	}
+	return done;
+}
+
+// Skips `size` bytes, without seeking since stdin can't
+static bool inputSkip(InputStream *stream, uint8 size) {
+	uint1 scratch[4096];
+	while(size > 0) {
+		unat chunk = size < sizeof(scratch) ? size : sizeof(scratch);
+		if(inputRead(stream, scratch, chunk) != chunk) return false;
+		size -= chunk;
+	}
+	return true;
+}
+
+/// Input streams ///
+/////////////////////
+
+////////////////////
+/// Mapped files ///
+
+structdef(MappedFile) {
+	const uint1 *data;
+	unat size;
+	#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+	#endif
+};
+
+static bool mapFile(const char *path, MappedFile *mapped) {
+	*mapped = (MappedFile) {0};
+	
+	#ifdef _WIN32
+	mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(mapped->file == INVALID_HANDLE_VALUE) return false;
+	
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0) {
+		CloseHandle(mapped->file);
+		return false;
+	}
+	
+	mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapped->mapping == NULL) {
+		CloseHandle(mapped->file);
+		return false;
+	}
+	
+	mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(mapped->data == NULL) {
+		CloseHandle(mapped->mapping);
+		CloseHandle(mapped->file);
+		return false;
+	}
+	mapped->size = size.QuadPart;
+	#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return false;
+	
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) return false;
+	
+	mapped->data = data;
+	mapped->size = st.st_size;
+	#endif
+	
+	return true;
+}
+
+static void unmapFile(MappedFile *mapped) {
+	if(mapped->data == NULL) return;
+	
+	#ifdef _WIN32
+	UnmapViewOfFile(mapped->data);
+	CloseHandle(mapped->mapping);
+	CloseHandle(mapped->file);
+	#else
+	munmap((void*)mapped->data, mapped->size);
+	#endif
+	
+	*mapped = (MappedFile) {0};
+}
+
+/// Mapped files ///
+////////////////////
+
+////////////////////
+/// Tar archives ///
+
+// Members of tar archives are read one after the other straight into memory, and become files of
+// their own, named like "archive.tar/path/in/archive". Understands ustar, GNU long names and pax
+// paths and sizes, everything that isn't a regular file gets skipped. Archives can be gzipped.
+
+#define TAR_BLOCK_SIZE 512
+
+// Sizes come from the archive, so anything that wouldn't fit in memory with its padding is broken
+#define TAR_MAX_MEMBER_SIZE ((uint8)(SIZE_MAX < INT64_MAX ? SIZE_MAX : INT64_MAX) - sizeof(FileData) - TAR_BLOCK_SIZE)
+// Long names and pax records are metadata, real ones are nowhere near this
+#define TAR_MAX_RECORDS_SIZE (1 << 20)
+
+static bool hasSuffix(String path, String suffix) {
+	return path.size > suffix.size && matchInsensitive((String) {.size = suffix.size, .start = path.start + path.size - suffix.size}, suffix);
+}
+
+static bool isTarPath(String path) {
+	return hasSuffix(path, litToString(".tar")) || hasSuffix(path, litToString(".tar.gz")) || hasSuffix(path, litToString(".tgz"));
+}
+
+
+// Numbers are octal text, or big endian binary if the first bit is set. Binary ones wider than
+// 63 bits don't parse
+static bool parseTarNumber(const uint1 *field, unat size, uint8 *value) {
+	*value = 0;
+	if(field[0] & 0x80) {
+		for(unat i = 0; i < size; i++) {
+			if(*value >> 55 != 0) return false;
+			*value = (*value << 8) | (i == 0 ? field[i] & 0x7f : field[i]);
+		}
+		return true;
+	}
+	
+	unat i = 0;
+	while(i < size && field[i] == ' ') i++;
+	for(; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+		*value = (*value << 3) | (field[i] - '0');
+	}
+	return i == size || field[i] == 0 || field[i] == ' ';
+}
+
+// Checks the checksum, which is the sum of the header bytes with its own field counted as spaces
+static bool isTarHeader(const uint1 *block) {
+	uint8 checksum;
+	if(!parseTarNumber(block + 148, 8, &checksum)) return false;
+	
+	uint4 sum = 8 * ' ';
+	for(unat i = 0; i < TAR_BLOCK_SIZE; i++) {
+		if(i < 148 || i >= 156) sum += block[i];
+	}
+	return sum == checksum;
+}
+
+static bool isZeroBlock(const uint1 *block) {
+	for(unat i = 0; i < TAR_BLOCK_SIZE; i++) {
+		if(block[i] != 0) return false;
+	}
+	return true;
+}
+
+// Member data is padded to whole blocks
+static bool readTarData(InputStream *input, void *buffer, uint8 size) {
+	if(inputRead(input, buffer, size) != size) return false;
+	return inputSkip(input, (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+}
+
+static bool skipTarData(InputStream *input, uint8 size) {
+	return inputSkip(input, (size + TAR_BLOCK_SIZE - 1) & ~(uint8)(TAR_BLOCK_SIZE - 1));
+}
+
+// Picks the path and size out of pax records, which look like "<length> <key>=<value>\n". A size
+// too big to be true becomes UINT64_MAX
+static void parsePaxRecords(char *records, unat size, char **path, uint8 *memberSize, bool *hasSize) {
+	char *at = records;
+	char *end = records + size;
+	while(at < end) {
+		char *space = memchr(at, ' ', end - at);
+		if(space == NULL) break;
+		
+		uint8 length = 0;
+		for(char *digit = at; digit < space; digit++) {
+			if(*digit < '0' || *digit > '9') return;
+			length = length * 10 + (*digit - '0');
+		}
+		if(length <= (uint8)(space - at) + 1 || length > (uint8)(end - at)) return;
+		
+		char *key = space + 1;
+		char *recordEnd = at + length - 1; // The newline
+		char *equals = memchr(key, '=', recordEnd - key);
+		if(equals != NULL) {
+			String name = {.size = equals - key, .start = key};
+			char *value = equals + 1;
+			
+			if(compareStrings(name, litToString("path")) == 0) {
+				arrsetlen(*path, 0);
+				memcpy(arraddnptr(*path, recordEnd - value), value, recordEnd - value);
+			} else if(compareStrings(name, litToString("size")) == 0) {
+				*memberSize = 0;
+				*hasSize = true;
+				for(char *digit = value; digit < recordEnd && *digit >= '0' && *digit <= '9'; digit++) {
+					if(*memberSize > (UINT64_MAX - 9) / 10) {
+						*memberSize = UINT64_MAX;
+						break;
+					}
+					*memberSize = *memberSize * 10 + (*digit - '0');
+				}
+			}
+		}
+		
+		at += length;
+	}
+}
+
+// Adds the regular files of a tar archive to `files`, with their data. `firstBlock` is the first
+// header, which was already read to tell the archive apart from other files. Members get `parent`
+// as their directory, and `archiveEntry` in front of their path.
+static bool readTar(InputStream *input, const uint1 *firstBlock, String archiveEntry, nat parent, bool dotfiles, NameArena *names, FileInfo **files, char **errorMessage) {
+	uint1 block[TAR_BLOCK_SIZE];
+	memcpy(block, firstBlock, TAR_BLOCK_SIZE);
+	
+	// Long names and pax paths/sizes are for the header that comes after them
+	char *longPath = NULL;
+	uint8 paxSize = 0;
+	bool hasPaxSize = false;
+	
+	char *path = NULL;
+	char *entry = NULL;
+	bool ok = true;
+	for(;;) {
+		if(isZeroBlock(block)) break;
+		if(!isTarHeader(block)) {
+			*errorMessage = "broken tar archive";
+			ok = false;
+			break;
+		}
+		
+		uint8 size;
+		bool sizeOk = parseTarNumber(block + 124, 12, &size);
+		if(hasPaxSize) size = paxSize;
+		char type = block[156];
+		
+		// Check the size before anything gets allocated or skipped with it
+		if(type == 'L' || type == 'x') sizeOk = sizeOk && size <= TAR_MAX_RECORDS_SIZE;
+		if(!sizeOk || size > TAR_MAX_MEMBER_SIZE) {
+			*errorMessage = "broken tar archive";
+			ok = false;
+			break;
+		}
+		
+		if(type == 'L' || type == 'x') {
+			char *records = malloc(size + 1);
+			if(records == NULL || !readTarData(input, records, size)) {
+				free(records);
+				*errorMessage = "broken tar archive";
+				ok = false;
+				break;
+			}
+			
+			if(type == 'L') {
+				arrsetlen(longPath, 0);
+				unat nameSize = strnlen(records, size);
+				memcpy(arraddnptr(longPath, nameSize), records, nameSize);
+			} else {
+				parsePaxRecords(records, size, &longPath, &paxSize, &hasPaxSize);
+			}
+			free(records);
+		} else {
+			// Put the path together from the prefix and name fields, unless it came from before
+			arrsetlen(path, 0);
+			if(arrlen(longPath) > 0) {
+				memcpy(arraddnptr(path, arrlen(longPath)), longPath, arrlen(longPath));
+			} else {
+				bool ustar = memcmp(block + 257, "ustar", 5) == 0;
+				unat prefixSize = ustar ? strnlen((char*)block + 345, 155) : 0;
+				if(prefixSize > 0) {
+					memcpy(arraddnptr(path, prefixSize), block + 345, prefixSize);
+					arrput(path, '/');
+				}
+				unat nameSize = strnlen((char*)block, 100);
+				memcpy(arraddnptr(path, nameSize), block, nameSize);
+			}
+			arrsetlen(longPath, 0);
+			hasPaxSize = false;
+			
+			// Leave out "./" in front, and dot names like directories would
+			char *member = path;
+			char *memberEnd = path + arrlen(path);
+			while(memberEnd - member >= 2 && member[0] == '.' && member[1] == '/') member += 2;
+			bool skip = type != '0' && type != '7' && type != 0;
+			skip = skip || size == 0 || member == memberEnd;
+			for(char *component = member; !skip && !dotfiles && component < memberEnd; component++) {
+				if(component[0] == '.' && (component == member || component[-1] == '/')) skip = true;
+			}
+			
+			if(skip) {
+				if(!skipTarData(input, size)) {
+					*errorMessage = "broken tar archive";
+					ok = false;
+					break;
+				}
+			} else {
+				FileData *fdata = malloc(sizeof(FileData) + size);
+				if(fdata == NULL) {
+					*errorMessage = "could not allocate memory";
+					ok = false;
+					break;
+				}
+				fdata->size = size;
+				
+				if(!readTarData(input, fdata->data, size)) {
+					free(fdata);
+					*errorMessage = "broken tar archive";
+					ok = false;
+					break;
+				}
+				
+				// "archive.tar/member"
+				arrsetlen(entry, 0);
+				memcpy(arraddnptr(entry, archiveEntry.size), archiveEntry.start, archiveEntry.size);
+				arrput(entry, '/');
+				memcpy(arraddnptr(entry, memberEnd - member), member, memberEnd - member);
+				
+				arrput(*files, ((FileInfo) {
+					.entry = {
+						.size = arrlen(entry),
+						.start = arenaCopy(names, entry, arrlen(entry))
+					},
+					.parent = parent,
+					.data = fdata
+				}));
+			}
+		}
+		
+		// The end is two zero blocks, but some writers leave out the second one, or both
+		unat blockSize = inputRead(input, block, TAR_BLOCK_SIZE);
+		if(blockSize == 0) break;
+		if(blockSize != TAR_BLOCK_SIZE) {
+			*errorMessage = "broken tar archive";
+			ok = false;
+			break;
+		}
+	}
+	
+	arrfree(path);
+	arrfree(entry);
+	arrfree(longPath);
+	return ok;
+}
+
+/// Tar archives ///
+////////////////////
+
+///////////////
+/// Threads ///
+
+// Just enough threading for splitting work up and showing progress: starting and joining threads,
+// counters that several threads can touch at once, and a clock
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef LPTHREAD_START_ROUTINE ThreadFunction;
+#define THREAD_FUNCTION(name) DWORD WINAPI name(LPVOID argument)
+#define THREAD_RETURN 0
+#else
+typedef pthread_t Thread;
+typedef void *(*ThreadFunction)(void *argument);
+#define THREAD_FUNCTION(name) void *name(void *argument)
+#define THREAD_RETURN NULL
+#endif
+
+static bool threadStart(Thread *thread, ThreadFunction function, void *argument) {
+	#ifdef _WIN32
+	*thread = CreateThread(NULL, 0, function, argument, 0, NULL);
+	return *thread != NULL;
+	#else
+	return pthread_create(thread, NULL, function, argument) == 0;
+	#endif
+}
+
+static void threadJoin(Thread thread) {
+	#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+	#else
+	pthread_join(thread, NULL);
+	#endif
+}
+
+static unat processorCount(void) {
+	#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+	#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+	#endif
+}
+
+// Returns the value from before. Only the counter itself is synchronized, nothing around it
+static inline nat atomicAdd(volatile nat *value, nat amount) {
+	#if defined(_WIN64)
+	return InterlockedExchangeAdd64((volatile LONG64*)value, amount);
+	#elif defined(_WIN32)
+	return InterlockedExchangeAdd((volatile LONG*)value, amount);
+	#else
+	return __atomic_fetch_add(value, amount, __ATOMIC_RELAXED);
+	#endif
+}
+
+// For counters with a single writer, which cost the same as plain ones this way. Aligned loads and
+// stores of a pointer's size are atomic on Windows already
+static inline void atomicStore(volatile nat *value, nat newValue) {
+	#ifdef _WIN32
+	*value = newValue;
+	#else
+	__atomic_store_n(value, newValue, __ATOMIC_RELAXED);
+	#endif
+}
+
+static inline nat atomicLoad(volatile nat *value) {
+	#ifdef _WIN32
+	return *value;
+	#else
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+	#endif
+}
+
+static double monotonicSeconds(void) {
+	#ifdef _WIN32
+	return GetTickCount64() / 1000.0;
+	#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+	#endif
+}
+
+static void sleepMilliseconds(unat milliseconds) {
+	#ifdef _WIN32
+	Sleep(milliseconds);
+	#else
+	struct timespec duration = {
+		.tv_sec = milliseconds / 1000,
+		.tv_nsec = (milliseconds % 1000) * 1000000
+	};
+	nanosleep(&duration, NULL);
+	#endif
+}
+
+/// Threads ///
+///////////////
+
+////////////////////
+/// Zip archives ///
+
+// Zip archives get mapped, and their entries found through the central directory at the end, so
+// only the entries themselves get read. Entries are decoded by several threads at once. Stored and
+// deflated entries work, zip64 too, anything else (like encrypted entries) gets left out.
+
+#define ZIP_END_SIZE 22
+
+static bool isZipPath(String path) {
+	return hasSuffix(path, litToString(".zip")) || hasSuffix(path, litToString(".jar")) || hasSuffix(path, litToString(".whl"));
+}
+
+static inline uint4 readLittleEndian2(const uint1 *bytes) {
+	return bytes[0] | (uint4)bytes[1] << 8;
+}
+
+static inline uint4 readLittleEndian4(const uint1 *bytes) {
+	return readLittleEndian2(bytes) | readLittleEndian2(bytes + 2) << 16;
+}
+
+static inline uint8 readLittleEndian8(const uint1 *bytes) {
+	return readLittleEndian4(bytes) | (uint8)readLittleEndian4(bytes + 4) << 32;
+}
+
+structdef(ZipEntry) {
+	const uint1 *data;
+	uint8 compressedSize;
+	uint8 size;
+	uint4 crc;
+	uint4 method;
+	FileData *result; // NULL if it couldn't be decoded
+};
+
+structdef(ZipJob) {
+	ZipEntry *entries;
+	nat count;
+	volatile nat next;
+};
+
+static void decodeZipEntry(ZipEntry *entry) {
+	entry->result = NULL;
+	
+	// The size comes from the central directory, so check that the data could even hold it before
+	// allocating that much
+	if(entry->method == 8 && entry->size > maxInflatedSize(entry->compressedSize)) return;
+	if(entry->method != 8 && entry->compressedSize != entry->size) return;
+	
+	FileData *fdata = malloc(sizeof(FileData) + entry->size);
+	if(fdata == NULL) return;
+	
+	// Entries get inflated straight into their file data, which can't grow past the size
+	if(entry->method == 8) {
+		fdata->size = 0;
+		Inflater inf = {
+			.in = entry->data,
+			.inSize = entry->compressedSize,
+			.target = fdata,
+			.targetCapacity = entry->size
+		};
+		if(!inflateRaw(&inf) || fdata->size != entry->size) {
+			free(fdata);
+			return;
+		}
+	} else {
+		fdata->size = entry->size;
+		memcpy(fdata->data, entry->data, entry->size);
+	}
+	
+	if(crc32Update(0, (const uint1*)fdata->data, fdata->size) != entry->crc) {
+		free(fdata);
+		return;
+	}
+	
+	entry->result = fdata;
+}
+
+static THREAD_FUNCTION(zipWorker) {
+	ZipJob *job = argument;
+	for(;;) {
+		nat i = atomicAdd(&job->next, 1);
+		if(i >= job->count) break;
+		decodeZipEntry(job->entries + i);
+	}
+	return THREAD_RETURN;
+}
+
+// Finds the central directory through the end of central directory record, which is followed by
+// a comment of up to 64K. Zip64 archives have another record with the real values before it
+static bool findZipDirectory(const uint1 *data, unat size, uint8 *offset, uint8 *directorySize, uint8 *entryCount) {
+	if(size < ZIP_END_SIZE) return false;
+	
+	const uint1 *end = NULL;
+	unat lowest = size > ZIP_END_SIZE + 0xffff ? size - ZIP_END_SIZE - 0xffff : 0;
+	for(unat at = size - ZIP_END_SIZE + 1; at-- > lowest;) {
+		if(readLittleEndian4(data + at) == 0x06054b50) {
+			end = data + at;
+			break;
+		}
+	}
+	if(end == NULL) return false;
+	
+	*entryCount = readLittleEndian2(end + 10);
+	*directorySize = readLittleEndian4(end + 12);
+	*offset = readLittleEndian4(end + 16);
+	
+	if(end - data >= 20 && readLittleEndian4(end - 20) == 0x07064b50) {
+		uint8 end64 = readLittleEndian8(end - 20 + 8);
+		if(size < 56 || end64 > size - 56 || readLittleEndian4(data + end64) != 0x06064b50) return false;
+		*entryCount = readLittleEndian8(data + end64 + 32);
+		*directorySize = readLittleEndian8(data + end64 + 40);
+		*offset = readLittleEndian8(data + end64 + 48);
+	}
+	
+	return *offset <= size && *directorySize <= size - *offset;
+}
+
+// Adds the files in a zip archive to `files`, with their data, like readTar() does
+static bool readZip(const char *path, String archiveEntry, nat parent, bool dotfiles, NameArena *names, FileInfo **files, char **errorMessage) {
+	MappedFile mapped;
+	if(!mapFile(path, &mapped)) {
+		*errorMessage = "could not open file";
+		return false;
+	}
+	
+	const uint1 *data = mapped.data;
+	unat size = mapped.size;
+	uint8 directoryOffset, directorySize, entryCount;
+	if(!findZipDirectory(data, size, &directoryOffset, &directorySize, &entryCount)) {
+		*errorMessage = "not a zip archive";
+		unmapFile(&mapped);
+		return false;
+	}
+	
+	ZipEntry *entries = NULL;
+	FileInfo *found = NULL;
+	char *entry = NULL;
+	bool ok = true;
+	
+	const uint1 *at = data + directoryOffset;
+	const uint1 *end = at + directorySize;
+	for(uint8 i = 0; i < entryCount; i++) {
+		if(end - at < 46 || readLittleEndian4(at) != 0x02014b50) {
+			*errorMessage = "broken zip archive";
+			ok = false;
+			break;
+		}
+		
+		uint4 flags = readLittleEndian2(at + 8);
+		ZipEntry zipEntry = {
+			.method = readLittleEndian2(at + 10),
+			.crc = readLittleEndian4(at + 16),
+			.compressedSize = readLittleEndian4(at + 20),
+			.size = readLittleEndian4(at + 24)
+		};
+		unat nameSize = readLittleEndian2(at + 28);
+		unat extraSize = readLittleEndian2(at + 30);
+		unat commentSize = readLittleEndian2(at + 32);
+		uint8 localOffset = readLittleEndian4(at + 42);
+		
+		const uint1 *name = at + 46;
+		const uint1 *extra = name + nameSize;
+		at = extra + extraSize + commentSize;
+		if(at > end) {
+			*errorMessage = "broken zip archive";
+			ok = false;
+			break;
+		}
+		
+		// Zip64 sizes and offsets are in an extra field, for the ones that didn't fit
+		for(const uint1 *field = extra; field + 4 <= extra + extraSize;) {
+			uint4 fieldId = readLittleEndian2(field);
+			uint4 fieldSize = readLittleEndian2(field + 2);
+			const uint1 *value = field + 4;
+			const uint1 *valueEnd = value + fieldSize;
+			if(valueEnd > extra + extraSize) break;
+			
+			if(fieldId == 0x0001) {
+				if(zipEntry.size == 0xffffffff && value + 8 <= valueEnd) {
+					zipEntry.size = readLittleEndian8(value);
+					value += 8;
+				}
+				if(zipEntry.compressedSize == 0xffffffff && value + 8 <= valueEnd) {
+					zipEntry.compressedSize = readLittleEndian8(value);
+					value += 8;
+				}
+				if(localOffset == 0xffffffff && value + 8 <= valueEnd) {
+					localOffset = readLittleEndian8(value);
+				}
+			}
+			field = valueEnd;
+		}
+		
+		// Leave out directories, empty and encrypted files, and dot names like directories would
+		bool skip = nameSize == 0 || name[nameSize - 1] == '/' || zipEntry.size == 0 || (flags & 1);
+		for(unat c = 0; !skip && !dotfiles && c < nameSize; c++) {
+			if(name[c] == '.' && (c == 0 || name[c - 1] == '/')) skip = true;
+		}
+		if(skip) continue;
+		
+		if(zipEntry.method != 0 && zipEntry.method != 8) {
+			*errorMessage = "some entries use unsupported compression";
+			ok = false;
+			continue;
+		}
+		
+		// The local header repeats the name, but has an extra field of its own
+		if(size < 30 || localOffset > size - 30 || readLittleEndian4(data + localOffset) != 0x04034b50) {
+			*errorMessage = "broken zip archive";
+			ok = false;
+			continue;
+		}
+		uint8 dataOffset = localOffset + 30 + readLittleEndian2(data + localOffset + 26) + readLittleEndian2(data + localOffset + 28);
+		if(dataOffset > size || zipEntry.compressedSize > size - dataOffset) {
+			*errorMessage = "broken zip archive";
+			ok = false;
+			continue;
+		}
+		zipEntry.data = data + dataOffset;
+		
+		// "archive.zip/member"
+		arrsetlen(entry, 0);
+		memcpy(arraddnptr(entry, archiveEntry.size), archiveEntry.start, archiveEntry.size);
+		arrput(entry, '/');
+		memcpy(arraddnptr(entry, nameSize), name, nameSize);
+		
+		arrput(entries, zipEntry);
+		arrput(found, ((FileInfo) {
+			.entry = {
+				.size = arrlen(entry),
+				.start = arenaCopy(names, entry, arrlen(entry))
+			},
+			.parent = parent
+		}));
+	}
+	
+	// Everything shared between the threads has to be set up before they start
+	buildFixedHuffman();
+	crc32Init();
+	
+	ZipJob job = {
+		.entries = entries,
+		.count = arrlen(entries)
+	};
+	
+	// The calling thread works too
+	unat threadCount = processorCount();
+	if(threadCount > (unat)job.count) threadCount = job.count;
+	if(threadCount > 64) threadCount = 64;
+	
+	Thread threads[64];
+	unat started = 0;
+	for(; started + 1 < threadCount; started++) {
+		if(!threadStart(threads + started, zipWorker, &job)) break;
+	}
+	zipWorker(&job);
+	for(unat t = 0; t < started; t++) threadJoin(threads[t]);
+	
+	for(nat i = 0; i < arrlen(entries); i++) {
+		if(entries[i].result == NULL) {
+			*errorMessage = "some entries could not be decoded";
+			ok = false;
+			continue;
+		}
+		
+		found[i].data = entries[i].result;
+		arrput(*files, found[i]);
+	}
+	
+	arrfree(entry);
+	arrfree(found);
+	arrfree(entries);
+	unmapFile(&mapped);
+	return ok;
+}
+
+/// Zip archives ///
+////////////////////
+
+// Tar and zip archives, and anything gzipped
+static bool isArchivePath(String path) {
+	return isTarPath(path) || isZipPath(path) || hasSuffix(path, litToString(".gz"));
+}
+
+///////////////////
+/// Git objects ///
+
+// Reads objects straight out of a local repository: loose objects, and packfiles through their
+// version 2 index, including delta objects. Only what's needed for reading commits, trees and
+// blobs is supported (no alternates, no shallow clone handling).
+
+#define GIT_ID_SIZE 20
+#define GIT_BASE_CACHE_SIZE 256
+
+enumdef(GitObjectType) {
+	GIT_NONE = 0,
+	GIT_COMMIT = 1,
+	GIT_TREE = 2,
+	GIT_BLOB = 3,
+	GIT_TAG = 4,
+	GIT_OFS_DELTA = 6,
+	GIT_REF_DELTA = 7,
+};
+
+structdef(GitPack) {
+	MappedFile index;
+	MappedFile pack;
+	uint4 objectCount;
+};
+
+// Delta bases get decoded over and over when walking history, so recently decoded pack objects
+// are kept around, indexed by their offset in the pack
+structdef(GitCachedObject) {
+	GitPack *pack;
+	unat offset;
+	GitObjectType type;
+	char *data; // stb_ds array
+};
+
+structdef(GitRepo) {
+	char gitDir[4096];
+	char commonDir[4096]; // Holds objects and refs, differs from gitDir for linked worktrees
+	GitPack *packs;
+	GitCachedObject cache[GIT_BASE_CACHE_SIZE];
+};
+
+static inline uint4 readBigEndian4(const uint1 *bytes) {
+	return (uint4)bytes[0] << 24 | (uint4)bytes[1] << 16 | (uint4)bytes[2] << 8 | bytes[3];
+}
+
+static bool parseGitId(const char *hex, uint1 *id) {
+	for(int i = 0; i < GIT_ID_SIZE * 2; i++) {
+		char c = toLower(hex[i]);
+		int digit;
+		if(c >= '0' && c <= '9') digit = c - '0';
+		else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+		else return false;
+		
+		if(i % 2 == 0) id[i / 2] = digit << 4;
+		else id[i / 2] |= digit;
+	}
+	return true;
+}
+
+static void formatGitId(const uint1 *id, char *hex) {
+	static const char digits[] = "0123456789abcdef";
+	for(int i = 0; i < GIT_ID_SIZE; i++) {
+		hex[i * 2] = digits[id[i] >> 4];
+		hex[i * 2 + 1] = digits[id[i] & 15];
+	}
+	hex[GIT_ID_SIZE * 2] = 0;
+}
+
+static bool isDirectory(const char *path) {
+	DIR *dir = opendir(path);
+	if(dir == NULL) return false;
+	closedir(dir);
+	return true;
+}
+
+// Reads a small text file (like a ref) into `buffer`, without the trailing newline
+static bool readSmallFile(const char *path, char *buffer, unat bufferSize) {
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) return false;
+	
+	unat size = fread(buffer, 1, bufferSize - 1, file);
+	fclose(file);
+	
+	while(size > 0 && (buffer[size - 1] == '\n' || buffer[size - 1] == '\r')) size--;
+	buffer[size] = 0;
+	return true;
+}
+
+static void gitLoadPacks(GitRepo *repo) {
+	char path[4096 + 64];
+	snprintf(path, sizeof(path), "%s/objects/pack", repo->commonDir);
+	
+	DIR *dir = opendir(path);
+	if(dir == NULL) return;
+	
+	struct dirent *ent;
+	while((ent = readdir(dir)) != NULL) {
+		unat nameSize = strlen(ent->d_name);
+		if(nameSize < 4 || strcmp(ent->d_name + nameSize - 4, ".idx") != 0) continue;
+		
+		GitPack pack = {0};
+		char indexPath[4096 + 512], packPath[4096 + 512];
+		snprintf(indexPath, sizeof(indexPath), "%s/%s", path, ent->d_name);
+		snprintf(packPath, sizeof(packPath), "%s/%.*s.pack", path, (int)(nameSize - 4), ent->d_name);
+		
+		if(!mapFile(indexPath, &pack.index)) continue;
+		if(!mapFile(packPath, &pack.pack)) {
+			unmapFile(&pack.index);
+			continue;
+		}
+		
+		// Only version 2 indices: magic, version, 256 entry fanout table
+		const uint1 *index = pack.index.data;
+		if(pack.index.size < 8 + 256 * 4 || readBigEndian4(index) != 0xff744f63 || readBigEndian4(index + 4) != 2) {
+			unmapFile(&pack.index);
+			unmapFile(&pack.pack);
+			continue;
+		}
+		
+		pack.objectCount = readBigEndian4(index + 8 + 255 * 4);
+		arrput(repo->packs, pack);
+	}
+	
+	closedir(dir);
+}
+
+// `path` can be a working tree, a .git directory, or a bare repository
+static bool gitOpen(GitRepo *repo, const char *path, char **errorMessage) {
+	*repo = (GitRepo) {0};
+	
+	// A path cut short would point somewhere else entirely, so every one of them has to fit
+	bool fits = true;
+	
+	char candidate[4096 + 64];
+	fits = fits && snprintf(candidate, sizeof(candidate), "%s/.git", path) < (int)sizeof(candidate);
+	
+	char link[4096];
+	if(fits && isDirectory(candidate)) {
+		fits = snprintf(repo->gitDir, sizeof(repo->gitDir), "%s", candidate) < (int)sizeof(repo->gitDir);
+	} else if(fits && readSmallFile(candidate, link, sizeof(link)) && strncmp(link, "gitdir: ", 8) == 0) {
+		// Linked worktrees and submodules have a .git file pointing at the real directory
+		if(link[8] == '/' || link[8] == '\\' || (link[8] != 0 && link[9] == ':')) {
+			fits = snprintf(repo->gitDir, sizeof(repo->gitDir), "%s", link + 8) < (int)sizeof(repo->gitDir);
+		} else {
+			fits = snprintf(repo->gitDir, sizeof(repo->gitDir), "%s/%s", path, link + 8) < (int)sizeof(repo->gitDir);
+		}
+	} else {
+		fits = fits && snprintf(repo->gitDir, sizeof(repo->gitDir), "%s", path) < (int)sizeof(repo->gitDir);
+	}
+	
+	fits = fits && snprintf(repo->commonDir, sizeof(repo->commonDir), "%s", repo->gitDir) < (int)sizeof(repo->commonDir);
+	fits = fits && snprintf(candidate, sizeof(candidate), "%s/commondir", repo->gitDir) < (int)sizeof(candidate);
+	if(fits && readSmallFile(candidate, link, sizeof(link))) {
+		if(link[0] == '/' || link[0] == '\\' || (link[0] != 0 && link[1] == ':')) {
+			fits = snprintf(repo->commonDir, sizeof(repo->commonDir), "%s", link) < (int)sizeof(repo->commonDir);
+		} else {
+			fits = snprintf(repo->commonDir, sizeof(repo->commonDir), "%s/%s", repo->gitDir, link) < (int)sizeof(repo->commonDir);
+		}
+	}
+	
+	if(!fits) {
+		*errorMessage = "path of the git repository is too long";
+		return false;
+	}
+	
+	snprintf(candidate, sizeof(candidate), "%s/objects", repo->commonDir);
+	if(!isDirectory(candidate)) {
+		*errorMessage = "not a git repository";
+		return false;
+	}
+	
+	gitLoadPacks(repo);
+	return true;
+}
+
+static void gitClose(GitRepo *repo) {
+	for(nat i = 0; i < arrlen(repo->packs); i++) {
+		unmapFile(&repo->packs[i].index);
+		unmapFile(&repo->packs[i].pack);
+	}
+	arrfree(repo->packs);
+	
+	for(int i = 0; i < GIT_BASE_CACHE_SIZE; i++) {
+		arrfree(repo->cache[i].data);
+	}
+}
+
+// Finds the offset of an object in a pack, or returns false if it's not in there
+static bool packFind(GitPack *pack, const uint1 *id, unat *offset) {
+	const uint1 *index = pack->index.data;
+	const uint1 *fanout = index + 8;
+	const uint1 *ids = fanout + 256 * 4;
+	
+	uint4 low = id[0] == 0 ? 0 : readBigEndian4(fanout + (id[0] - 1) * 4);
+	uint4 high = readBigEndian4(fanout + id[0] * 4);
+	
+	while(low < high) {
+		uint4 middle = low + (high - low) / 2;
+		int comparison = memcmp(ids + (unat)middle * GIT_ID_SIZE, id, GIT_ID_SIZE);
+		if(comparison == 0) {
+			// After the ids come a CRC per object, then 4 byte offsets, then 8 byte offsets for big packs
+			const uint1 *offsets = ids + (unat)pack->objectCount * (GIT_ID_SIZE + 4);
+			uint4 small = readBigEndian4(offsets + (unat)middle * 4);
+			if(small & 0x80000000) {
+				const uint1 *large = offsets + (unat)pack->objectCount * 4 + (unat)(small & 0x7fffffff) * 8;
+				*offset = (unat)readBigEndian4(large) << 32 | readBigEndian4(large + 4);
+			} else {
+				*offset = small;
+			}
+			return true;
+		}
+		
+		if(comparison < 0) low = middle + 1;
+		else high = middle;
+	}
+	
+	return false;
+}
+
+static unat readDeltaSize(const uint1 **at, const uint1 *end) {
+	unat size = 0;
+	int shift = 0;
+	while(*at < end) {
+		uint1 byte = *(*at)++;
+		size |= (unat)(byte & 0x7f) << shift;
+		shift += 7;
+		if(!(byte & 0x80)) break;
+	}
+	return size;
+}
+
+// Applies a git delta to `base`, returns the result as a new stb_ds array or NULL
+static char *applyDelta(const char *base, unat baseSize, const char *delta, unat deltaSize) {
+	const uint1 *at = (const uint1*)delta;
+	const uint1 *end = at + deltaSize;
+	
+	if(readDeltaSize(&at, end) != baseSize) return NULL;
+	unat resultSize = readDeltaSize(&at, end);
+	
+	// The size comes from the delta, so it only sizes the result up front as far as it's plausible.
+	// Every byte of the result gets copied from the base or the delta, and the size gets checked
+	// at the end
+	unat capacity = resultSize;
+	if(capacity > baseSize + deltaSize) capacity = baseSize + deltaSize;
+	
+	char *result = NULL;
+	arrsetcap(result, capacity > 0 ? capacity : 1);
+	
+	while(at < end) {
+		uint1 op = *at++;
+		if(op & 0x80) {
+			// Copy from the base, offset and size bytes are only present if their bit is set
+			unat offset = 0, size = 0;
+			for(int i = 0; i < 4; i++) {
+				if(op & (1 << i)) offset |= (unat)(at < end ? *at++ : 0) << (i * 8);
+			}
+			for(int i = 0; i < 3; i++) {
+				if(op & (0x10 << i)) size |= (unat)(at < end ? *at++ : 0) << (i * 8);
+			}
+			if(size == 0) size = 0x10000;
+			
+			if(offset + size > baseSize) break;
+			memcpy(arraddnptr(result, size), base + offset, size);
+		} else if(op != 0) {
+			// Insert the next `op` bytes of the delta
+			if(op > end - at) break;
+			memcpy(arraddnptr(result, op), at, op);
+			at += op;
+		} else {
+			break;
+		}
+	}
+	
+	if(at != end || (unat)arrlen(result) != resultSize) {
+		arrfree(result);
+		return NULL;
+	}
+	
+	return result;
+}
+
+// Deltas can have deltas as their base, but not more than this many times. Bad packs could
+// otherwise make a cycle of them
+#define GIT_MAX_DELTA_DEPTH 64
+
+static char *readObjectAtDepth(GitRepo *repo, const uint1 *id, GitObjectType *type, int depth);
+
+static char *packReadObject(GitRepo *repo, GitPack *pack, unat offset, GitObjectType *type, int depth) {
+	if(depth > GIT_MAX_DELTA_DEPTH || offset >= pack->pack.size) return NULL;
+	
+	GitCachedObject *cached = repo->cache + (offset ^ (unat)(pack - repo->packs) * 7919) % GIT_BASE_CACHE_SIZE;
+	if(cached->data != NULL && cached->pack == pack && cached->offset == offset) {
+		*type = cached->type;
+		char *copy = NULL;
+		arrsetcap(copy, arrlen(cached->data) + 1);
+		memcpy(arraddnptr(copy, arrlen(cached->data)), cached->data, arrlen(cached->data));
+		return copy;
+	}
+	
+	const uint1 *at = pack->pack.data + offset;
+	const uint1 *end = pack->pack.data + pack->pack.size;
+	
+	// Object header: type in bits 4-6 of the first byte, then the size in little endian 7 bit groups
+	uint1 byte = *at++;
+	GitObjectType objectType = (byte >> 4) & 7;
+	unat size = byte & 15;
+	int shift = 4;
+	while((byte & 0x80) && at < end) {
+		byte = *at++;
+		size |= (unat)(byte & 0x7f) << shift;
+		shift += 7;
+	}
+	
+	char *result = NULL;
+	
+	if(objectType == GIT_OFS_DELTA || objectType == GIT_REF_DELTA) {
+		char *base = NULL;
+		GitObjectType baseType = GIT_NONE;
+		
+		if(objectType == GIT_OFS_DELTA) {
+			// Negative offset to the base object, with an odd encoding where every continuation adds one
+			byte = at < end ? *at++ : 0;
+			unat relative = byte & 0x7f;
+			while((byte & 0x80) && at < end) {
+				byte = *at++;
+				relative = ((relative + 1) << 7) | (byte & 0x7f);
+			}
+			if(relative > offset) return NULL;
+			base = packReadObject(repo, pack, offset - relative, &baseType, depth + 1);
+		} else {
+			if(end - at < GIT_ID_SIZE) return NULL;
+			base = readObjectAtDepth(repo, at, &baseType, depth + 1);
+			at += GIT_ID_SIZE;
+		}
+		
+		if(base == NULL) return NULL;
+		if(size > maxInflatedSize(end - at)) {
+			arrfree(base);
+			return NULL;
+		}
+		
+		char *delta = inflateZlib(at, end - at, size);
+		if(delta != NULL) {
+			result = applyDelta(base, arrlen(base), delta, arrlen(delta));
+			arrfree(delta);
+		}
+		arrfree(base);
+		objectType = baseType;
+	} else if(objectType >= GIT_COMMIT && objectType <= GIT_TAG) {
+		if(size > maxInflatedSize(end - at)) return NULL;
+		result = inflateZlib(at, end - at, size);
+		if(result != NULL && (unat)arrlen(result) != size) {
+			arrfree(result);
+			result = NULL;
+		}
+	}
+	
+	if(result == NULL) return NULL;
+	
+	// Trees and commits make for most delta bases, big blobs would just churn the cache
+	if(objectType != GIT_BLOB || arrlen(result) < 64 * 1024) {
+		arrsetlen(cached->data, 0);
+		memcpy(arraddnptr(cached->data, arrlen(result)), result, arrlen(result));
+		cached->pack = pack;
+		cached->offset = offset;
+		cached->type = objectType;
+	}
+	
+	*type = objectType;
+	return result;
+}
+
+static char *readLooseObject(GitRepo *repo, const uint1 *id, GitObjectType *type) {
+	char hex[GIT_ID_SIZE * 2 + 1];
+	formatGitId(id, hex);
+	
+	char path[4096 + 128];
+	snprintf(path, sizeof(path), "%s/objects/%.2s/%s", repo->commonDir, hex, hex + 2);
+	
+	MappedFile mapped;
+	if(!mapFile(path, &mapped)) return NULL;
+	
+	char *object = inflateZlib(mapped.data, mapped.size, mapped.size * 4);
+	unmapFile(&mapped);
+	if(object == NULL) return NULL;
+	
+	// Loose objects start with a "<type> <size>\0" header
+	char *headerEnd = memchr(object, 0, arrlen(object));
+	if(headerEnd == NULL) {
+		arrfree(object);
+		return NULL;
+	}
+	
+	if(strncmp(object, "commit ", 7) == 0) *type = GIT_COMMIT;
+	else if(strncmp(object, "tree ", 5) == 0) *type = GIT_TREE;
+	else if(strncmp(object, "blob ", 5) == 0) *type = GIT_BLOB;
+	else if(strncmp(object, "tag ", 4) == 0) *type = GIT_TAG;
+	else *type = GIT_NONE;
+	
+	unat headerSize = headerEnd + 1 - object;
+	arrdeln(object, 0, headerSize);
+	return object;
+}
+
+// `depth` counts the deltas that led here, since bases named by id can be deltas themselves
+static char *readObjectAtDepth(GitRepo *repo, const uint1 *id, GitObjectType *type, int depth) {
+	for(nat i = 0; i < arrlen(repo->packs); i++) {
+		unat offset;
+		if(packFind(repo->packs + i, id, &offset)) {
+			return packReadObject(repo, repo->packs + i, offset, type, depth);
+		}
+	}
+	
+	return readLooseObject(repo, id, type);
+}
+
+// Returns the contents of an object as a stb_ds array, or NULL if it can't be found or read
+static char *gitReadObject(GitRepo *repo, const uint1 *id, GitObjectType *type) {
+	return readObjectAtDepth(repo, id, type, 0);
+}
+
+static bool gitResolveRef(GitRepo *repo, const char *name, uint1 *id, int depth) {
+	if(depth > 8) return false;
+	
+	if(strlen(name) == GIT_ID_SIZE * 2 && parseGitId(name, id)) return true;
+	
+	static const char *prefixes[] = {"", "refs/", "refs/tags/", "refs/heads/", "refs/remotes/"};
+	char path[4096 + 1024];
+	char content[1024];
+	
+	for(unat i = 0; i < sizeof(prefixes) / sizeof(*prefixes); i++) {
+		// HEAD lives in the worktree's own git directory, everything else in the common one
+		const char *dir = i == 0 && strcmp(name, "HEAD") == 0 ? repo->gitDir : repo->commonDir;
+		snprintf(path, sizeof(path), "%s/%s%s", dir, prefixes[i], name);
+		if(isDirectory(path) || !readSmallFile(path, content, sizeof(content))) continue;
+		
+		if(strncmp(content, "ref: ", 5) == 0) return gitResolveRef(repo, content + 5, id, depth + 1);
+		if(strlen(content) >= GIT_ID_SIZE * 2 && parseGitId(content, id)) return true;
+	}
+	
+	// Refs can also be packed, as "<id> <name>" lines
+	snprintf(path, sizeof(path), "%s/packed-refs", repo->commonDir);
+	FILE *file = fopen(path, "rb");
+	if(file == NULL) return false;
+	
+	bool found = false;
+	char line[2048];
+	while(!found && fgets(line, sizeof(line), file) != NULL) {
+		if(line[0] == '#' || line[0] == '^' || strlen(line) < GIT_ID_SIZE * 2 + 2) continue;
+		
+		char *refName = line + GIT_ID_SIZE * 2 + 1;
+		refName[strcspn(refName, "\r\n")] = 0;
+		
+		for(unat i = 0; i < sizeof(prefixes) / sizeof(*prefixes); i++) {
+			unat prefixSize = strlen(prefixes[i]);
+			if(strncmp(refName, prefixes[i], prefixSize) == 0 && strcmp(refName + prefixSize, name) == 0) {
+				found = parseGitId(line, id);
+				break;
+			}
+		}
+	}
+	
+	fclose(file);
+	return found;
+}
+
+structdef(GitCommit) {
+	uint1 tree[GIT_ID_SIZE];
+	uint1 parent[GIT_ID_SIZE];
+	bool hasParent;
+	int8 time;
+	char subject[256];
+};
+
+static bool gitReadCommit(GitRepo *repo, const uint1 *id, GitCommit *commit) {
+	GitObjectType type;
+	char *object = gitReadObject(repo, id, &type);
+	if(object == NULL) return false;
+	
+	if(type != GIT_COMMIT) {
+		arrfree(object);
+		return false;
+	}
+	
+	*commit = (GitCommit) {0};
+	bool hasTree = false;
+	
+	char *at = object;
+	char *end = object + arrlen(object);
+	while(at < end) {
+		char *lineEnd = memchr(at, '\n', end - at);
+		if(lineEnd == NULL) lineEnd = end;
+		
+		// An empty line ends the headers, the message follows
+		if(lineEnd == at) {
+			at++;
+			char *subjectEnd = memchr(at, '\n', end - at);
+			if(subjectEnd == NULL) subjectEnd = end;
+			snprintf(commit->subject, sizeof(commit->subject), "%.*s", (int)(subjectEnd - at), at);
+			break;
+		}
+		
+		unat lineSize = lineEnd - at;
+		if(lineSize >= 5 + GIT_ID_SIZE * 2 && strncmp(at, "tree ", 5) == 0) {
+			hasTree = parseGitId(at + 5, commit->tree);
+		} else if(!commit->hasParent && lineSize >= 7 + GIT_ID_SIZE * 2 && strncmp(at, "parent ", 7) == 0) {
+			commit->hasParent = parseGitId(at + 7, commit->parent);
+		} else if(lineSize > 10 && strncmp(at, "committer ", 10) == 0) {
+			// "committer Name <email> 1700000000 +0100"
+			char *timeStart = memchr(at, '>', lineSize);
+			if(timeStart != NULL) commit->time = strtoll(timeStart + 1, NULL, 10);
+		}
+		
+		at = lineEnd + 1;
+	}
+	
+	arrfree(object);
+	return hasTree;
+}
+
+structdef(GitTreeEntry) {
+	String mode;
+	String name;
+	const uint1 *id;
+};
+
+// Steps through the entries of a tree object, which look like "<octal mode> <name>\0<binary id>".
+// Returns false at the end, or if the entry is broken (then `*at` doesn't move)
+static bool nextTreeEntry(char **at, char *end, GitTreeEntry *entry) {
+	char *space = memchr(*at, ' ', end - *at);
+	char *nameEnd = space != NULL ? memchr(space, 0, end - space) : NULL;
+	if(nameEnd == NULL || end - nameEnd < 1 + GIT_ID_SIZE) return false;
+	
+	entry->mode = (String) {.start = *at, .size = space - *at};
+	entry->name = (String) {.start = space + 1, .size = nameEnd - space - 1};
+	entry->id = (const uint1*)nameEnd + 1;
+	*at = nameEnd + 1 + GIT_ID_SIZE;
+	return true;
+}
+
+static inline bool isTreeMode(String mode) {
+	return compareStrings(mode, litToString("40000")) == 0;
+}
+
+// Symlinks and submodules aren't files of the repository
+static inline bool isFileMode(String mode) {
+	return compareStrings(mode, litToString("120000")) != 0 && compareStrings(mode, litToString("160000")) != 0;
+}
+
+// Resolves revisions like "HEAD", "main", "v1.0", a full object id, each optionally followed by
+// "~N" to go N first parents back
+static bool gitResolve(GitRepo *repo, const char *revision, uint1 *id) {
+	char name[1024];
+	snprintf(name, sizeof(name), "%s", revision);
+	
+	unat back = 0;
+	char *tilde = strchr(name, '~');
+	if(tilde != NULL) {
+		*tilde = 0;
+		back = tilde[1] == 0 ? 1 : strtoull(tilde + 1, NULL, 10);
+	}
+	
+	if(!gitResolveRef(repo, name, id, 0)) return false;
+	
+	// Annotated tags point at the commit with an "object" header
+	GitObjectType type = GIT_TAG;
+	for(int depth = 0; type == GIT_TAG && depth < 8; depth++) {
+		char *object = gitReadObject(repo, id, &type);
+		if(object == NULL) return false;
+		
+		bool ok = type != GIT_TAG || (arrlen(object) > 7 + GIT_ID_SIZE * 2 && strncmp(object, "object ", 7) == 0 && parseGitId(object + 7, id));
+		arrfree(object);
+		if(!ok) return false;
+	}
+	
+	for(unat i = 0; i < back; i++) {
+		GitCommit commit;
+		if(!gitReadCommit(repo, id, &commit) || !commit.hasParent) return false;
+		memcpy(id, commit.parent, GIT_ID_SIZE);
+	}
+	
+	return true;
+}
+
+/// Git objects ///
+///////////////////
+
+////////////////////
+/// Fingerprints ///
+
+// A fingerprint is a 64 bit hash of a line, with how many times it occurs. Sets of them are kept
+// sorted by hash, so comparing two scans comes down to walking two arrays side by side, and they
+// are small enough to be saved and compared later.
+//
+// A saved set is a header followed by the fingerprints:
+//   [16 byte magic][uint8 settings][uint8 count] then [uint8 hash][uint8 count] per fingerprint
+
+#define FINGERPRINT_MAGIC "uloc-fingerprint"
+#define FINGERPRINT_HEADER_SIZE (16 + 8 + 8)
+
+structdef(Fingerprint) {
+	uint8 hash;
+	uint8 count;
+};
+
+static uint8 lineFingerprint(String line) {
+	uint8 hash = 0x9e3779b97f4a7c15ull ^ line.size;
+	
+	unat i = 0;
+	for(; i + 8 <= line.size; i += 8) {
+		hash = (hash ^ loadWord(line.start + i)) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	
+	uint8 tail = 0;
+	memcpy(&tail, line.start + i, line.size - i);
+	hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+	
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+static int compareFingerprints(const void *left, const void *right) {
+	uint8 a = ((const Fingerprint*)left)->hash;
+	uint8 b = ((const Fingerprint*)right)->hash;
+	return (a > b) - (a < b);
+}
+
+// Sorts fingerprints and adds up the counts of equal ones, in place. Returns the new count
+static unat mergeFingerprints(Fingerprint *items, unat count) {
+	if(count == 0) return 0;
+	qsort(items, count, sizeof(*items), compareFingerprints);
+	
+	unat merged = 0;
+	for(unat i = 1; i < count; i++) {
+		if(items[i].hash == items[merged].hash) {
+			items[merged].count += items[i].count;
+		} else {
+			items[++merged] = items[i];
+		}
+	}
+	
+	return merged + 1;
+}
+
+static Fingerprint *findFingerprint(Fingerprint *set, unat count, uint8 hash) {
+	unat low = 0, high = count;
+	while(low < high) {
+		unat middle = low + (high - low) / 2;
+		if(set[middle].hash == hash) return set + middle;
+		if(set[middle].hash < hash) low = middle + 1;
+		else high = middle;
+	}
+	return NULL;
+}
+
+// Lines that occur at least twice in `after`, but not in `before`. Counts are the ones of `after`
+static Fingerprint *newlyDuplicated(Fingerprint *before, unat beforeCount, Fingerprint *after, unat afterCount) {
+	Fingerprint *result = NULL;
+	
+	unat b = 0;
+	for(unat a = 0; a < afterCount; a++) {
+		if(after[a].count < 2) continue;
+		
+		while(b < beforeCount && before[b].hash < after[a].hash) b++;
+		if(b < beforeCount && before[b].hash == after[a].hash && before[b].count >= 2) continue;
+		
+		arrput(result, after[a]);
+	}
+	
+	return result;
+}
+
+static bool saveFingerprints(const char *path, uint8 settings, Fingerprint *set, unat count) {
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) return false;
+	
+	uint8 count8 = count;
+	bool ok = fwrite(FINGERPRINT_MAGIC, 1, 16, file) == 16;
+	ok = ok && fwrite(&settings, 8, 1, file) == 1;
+	ok = ok && fwrite(&count8, 8, 1, file) == 1;
+	ok = ok && fwrite(set, sizeof(*set), count, file) == count;
+	
+	if(fclose(file) != 0) ok = false;
+	return ok;
+}
+
+// Returns false if `path` isn't a saved fingerprint set. The set is an stb_ds array
+static bool loadFingerprints(const char *path, Fingerprint **set, uint8 *settings) {
+	MappedFile mapped;
+	if(!mapFile(path, &mapped)) return false;
+	
+	uint8 count = 0;
+	bool ok = mapped.size >= FINGERPRINT_HEADER_SIZE && memcmp(mapped.data, FINGERPRINT_MAGIC, 16) == 0;
+	if(ok) {
+		memcpy(settings, mapped.data + 16, 8);
+		memcpy(&count, mapped.data + 24, 8);
+		ok = count <= (mapped.size - FINGERPRINT_HEADER_SIZE) / sizeof(Fingerprint);
+	}
+	
+	if(ok) {
+		*set = NULL;
+		arrsetcap(*set, count + 1);
+		memcpy(arraddnptr(*set, count), mapped.data + FINGERPRINT_HEADER_SIZE, count * sizeof(Fingerprint));
+	}
+	
+	unmapFile(&mapped);
+	return ok;
+}
+
+/// Fingerprints ///
+////////////////////
+
+///////////////////
+/// HyperLogLog ///
+
+// Estimates how many different lines there are without keeping the lines around. The fingerprint
+// of a line picks one of 2^precision registers with its top bits, and the register remembers the
+// most leading zeros seen in the rest of it. Memory is one byte per register, and the standard
+// error is about 1.04 / sqrt(2^precision). Sketches with the same precision merge by taking the
+// larger value of every register, so they can be saved and combined across runs.
+//
+// A saved sketch is a header followed by the registers, with the number of source lines that went
+// into it so totals add up after merging:
+//   [16 byte magic][uint8 settings][uint8 precision][uint8 line count] then one byte per register
+
+#define SKETCH_MAGIC "uloc-hll-sketch"
+#define SKETCH_HEADER_SIZE (16 + 8 + 8 + 8)
+#define SKETCH_MIN_PRECISION 4
+#define SKETCH_MAX_PRECISION 18
+
+structdef(Sketch) {
+	int precision;
+	uint1 *registers; // NULL when not estimating
+};
+
+// The smallest precision with a standard error of at most `error`
+static int sketchPrecision(double error) {
+	int precision = SKETCH_MIN_PRECISION;
+	while(precision < SKETCH_MAX_PRECISION && 1.04 * 1.04 > error * error * (double)((unat)1 << precision)) {
+		precision++;
+	}
+	return precision;
+}
+
+static inline double sketchError(int precision) {
+	// 1.04 / sqrt(2^precision), halving the square root for odd precisions
+	double error = 1.04 / (double)((unat)1 << (precision / 2));
+	return precision % 2 ? error * 0.70710678118654752 : error;
+}
+
+static void sketchInit(Sketch *sketch, int precision) {
+	sketch->precision = precision;
+	sketch->registers = calloc((unat)1 << precision, 1);
+}
+
+static void sketchFree(Sketch *sketch) {
+	free(sketch->registers);
+	*sketch = (Sketch) {0};
+}
+
+static inline void sketchAdd(Sketch *sketch, uint8 hash) {
+	unat index = hash >> (64 - sketch->precision);
+	uint8 rest = hash << sketch->precision;
+	
+	uint1 rank = 1;
+	for(; rank <= 64 - sketch->precision && !(rest & 0x8000000000000000ull); rank++) rest <<= 1;
+	
+	if(sketch->registers[index] < rank) sketch->registers[index] = rank;
+}
+
+// Returns false if the sketches don't have the same precision
+static bool sketchMerge(Sketch *into, const Sketch *from) {
+	if(into->precision != from->precision) return false;
+	
+	unat count = (unat)1 << into->precision;
+	for(unat i = 0; i < count; i++) {
+		if(into->registers[i] < from->registers[i]) into->registers[i] = from->registers[i];
+	}
+	return true;
+}
+
+// Good to about 15 digits for positive numbers, so the estimate doesn't need libm
+static double naturalLog(double x) {
+	int exponent = 0;
+	while(x > 2) {
+		x *= 0.5;
+		exponent++;
+	}
+	while(x < 1) {
+		x *= 2;
+		exponent--;
+	}
+	
+	// ln(x) = 2 atanh((x - 1) / (x + 1)), which converges quickly for x in [1, 2]
+	double y = (x - 1) / (x + 1);
+	double power = y;
+	double sum = 0;
+	for(int i = 1; i < 64; i += 2) {
+		sum += power / i;
+		power *= y * y;
+	}
+	
+	return 2 * sum + exponent * 0.69314718055994531;
+}
+
+static unat sketchEstimate(const Sketch *sketch) {
+	unat count = (unat)1 << sketch->precision;
+	
+	double sum = 0;
+	unat zeros = 0;
+	for(unat i = 0; i < count; i++) {
+		sum += 1.0 / (double)((uint8)1 << sketch->registers[i]);
+		if(sketch->registers[i] == 0) zeros++;
+	}
+	
+	double alpha;
+	switch(count) {
+		case 16: alpha = 0.673; break;
+		case 32: alpha = 0.697; break;
+		case 64: alpha = 0.709; break;
+		default: alpha = 0.7213 / (1 + 1.079 / count); break;
+	}
+	
+	double estimate = alpha * count * count / sum;
+	
+	// With few lines most registers are still empty, and counting those is more accurate
+	if(estimate <= 2.5 * count && zeros > 0) {
+		estimate = count * naturalLog((double)count / zeros);
+	}
+	
+	return (unat)(estimate + 0.5);
+}
+
+static bool saveSketch(const char *path, uint8 settings, const Sketch *sketch, uint8 lineCount) {
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) return false;
+	
+	uint8 precision = sketch->precision;
+	unat count = (unat)1 << sketch->precision;
+	bool ok = fwrite(SKETCH_MAGIC, 1, 16, file) == 16;
+	ok = ok && fwrite(&settings, 8, 1, file) == 1;
+	ok = ok && fwrite(&precision, 8, 1, file) == 1;
+	ok = ok && fwrite(&lineCount, 8, 1, file) == 1;
+	ok = ok && fwrite(sketch->registers, 1, count, file) == count;
+	
+	if(fclose(file) != 0) ok = false;
+	return ok;
+}
+
+// Returns false if `path` isn't a saved sketch
+static bool loadSketch(const char *path, Sketch *sketch, uint8 *settings, uint8 *lineCount) {
+	MappedFile mapped;
+	if(!mapFile(path, &mapped)) return false;
+	
+	uint8 precision = 0;
+	bool ok = mapped.size >= SKETCH_HEADER_SIZE && memcmp(mapped.data, SKETCH_MAGIC, 16) == 0;
+	if(ok) {
+		memcpy(settings, mapped.data + 16, 8);
+		memcpy(&precision, mapped.data + 24, 8);
+		memcpy(lineCount, mapped.data + 32, 8);
+		ok = precision >= SKETCH_MIN_PRECISION && precision <= SKETCH_MAX_PRECISION;
+		ok = ok && mapped.size - SKETCH_HEADER_SIZE == (unat)1 << precision;
+	}
+	
+	if(ok) {
+		sketchInit(sketch, precision);
+		memcpy(sketch->registers, mapped.data + SKETCH_HEADER_SIZE, (unat)1 << precision);
+	}
+	
+	unmapFile(&mapped);
+	return ok;
+}
+
+/// HyperLogLog ///
+///////////////////
+
+//////////////////////
+/// Scanning state ///
+
+enumdef(ProgressPhase) {
+	PROGRESS_FINDING,
+	PROGRESS_READING,
+	PROGRESS_COUNTING,
+	PROGRESS_TOTAL,
+};
+
+// Counters for showing progress from another thread. Only the scanning thread writes them, once per
+// file or directory rather than in the inner loops
+structdef(UlocProgress) {
+	volatile nat phase;
+	volatile nat dirs;
+	volatile nat filesFound;
+	volatile nat filesRead;
+	volatile nat filesCounted;
+	volatile nat bytes; // Counted so far
+	volatile nat lines;
+};
+
+// Distributions filled in while counting. Lengths and copies are in power of two buckets, the last
+// bucket of each taking everything above it
+#define LENGTH_BUCKETS 12 // 1, 2-3, 4-7, ... 1024-2047, 2048 and up
+#define RATIO_BUCKETS 10  // 0-10%, 10-20%, ... 90-100%
+#define COPIES_BUCKETS 8  // 1, 2, 3-4, 5-8, ... 33-64, 65 and up
+
+structdef(Histograms) {
+	unat lineLength[LENGTH_BUCKETS]; // Lines counted, by their length after normalization
+	unat fileRatio[RATIO_BUCKETS];   // Files, by their unique ratio
+	unat lineCopies[COPIES_BUCKETS]; // Different lines of each file, by how often they're in it
+};
+
+static inline int floorLog2(unat value) {
+	int log = 0;
+	while(value >>= 1) log++;
+	return log;
+}
+
+static inline int lengthBucket(unat length) {
+	int bucket = floorLog2(length);
+	return bucket < LENGTH_BUCKETS ? bucket : LENGTH_BUCKETS - 1;
+}
+
+static inline int copiesBucket(unat copies) {
+	int bucket = copies > 1 ? floorLog2(copies - 1) + 1 : 0;
+	return bucket < COPIES_BUCKETS ? bucket : COPIES_BUCKETS - 1;
+}
+
+struct Uloc {
+	FileInfo *files;
+	DirNode *dirs;
+	NameArena names;
+	char *pathBuffer;
+	
+	// Holds the unique lines of every file counted so far, one sorted run per file
+	String *lines;
+	unat *runOffsets;
+	unat lineCount;
+	
+	// With a memory limit, runs get merged and written out to temporary files once the file
+	// data and lines kept in memory go over it. Files before `firstResident` no longer have data.
+	// This assumes files get counted in the order they appear in `files`
+	unat memoryLimit;
+	unat memoryUsed;
+	nat firstResident;
+	FILE **spills;
+	
+	bool dotfiles;
+	char slash;
+	int normalize;
+	bool stripComments;
+	bool skipTrivial;
+	StopSet stopLines;
+	
+	// Fingerprints of the unique lines of every file, with how often they occur in it
+	bool collectFingerprints;
+	Fingerprint *fingerprints;
+	unat *fingerprintOffsets;
+	
+	// With a sketch, the unique lines of every file go into it and then get dropped, and the total
+	// is an estimate
+	Sketch sketch;
+	
+	Histograms *histograms; // NULL unless they're wanted
+	
+	UlocProgress progress;
+	
+	char *error;
+};
+
+static inline String ulocFilePath(Uloc *uloc, FileInfo *finfo) {
+	return filePath(&uloc->pathBuffer, uloc->dirs, finfo, uloc->slash);
+}
+
+// Forgets about the files from `first` on, as if they were never found. They must not have been
+// counted yet
+static void dropFiles(Uloc *uloc, nat first) {
+	for(nat i = first; i < arrlen(uloc->files); i++) {
+		free(uloc->files[i].data);
+	}
+	arrsetlen(uloc->files, first);
+}
+
+// Replace directories in the file list (starting at `first`) with the entries inside of them
+static void findFiles(Uloc *uloc, nat first) {
+	for(nat i = first; i < arrlen(uloc->files); i++) {
+		FileInfo *finfo = uloc->files + i;
+		String path = ulocFilePath(uloc, finfo);
+		
+		DIR *dir = opendir(path.start);
+		
+		// NOTE: If dir is NULL, it's probably not a directory.
+		// If it doesn't exist at all, we'll print a warning later.
+		if(dir != NULL) {
+			nat dirIndex = arrlen(uloc->dirs);
+			arrput(uloc->dirs, ((DirNode) {
+				.name = finfo->entry,
+				.parent = finfo->parent
+			}));
+			
+			struct dirent *ent;
+			while((ent = readdir(dir)) != NULL) {
+				if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+				
+				// I assume we can't have 0 length filenames
+				if(!uloc->dotfiles && ent->d_name[0] == '.') continue;
+				
+				unat d_namlen = strlen(ent->d_name);
+				
+				// Only the entry name gets stored, the directory part of the path lives in `dirs`
+				String entry = {
+					.size = d_namlen,
+					.start = arenaCopy(&uloc->names, ent->d_name, d_namlen)
+				};
+				
+				// Add to file list. We don't know if it's a directory yet, but it'll get taken
+				// care of in the outer loop, since we're pushing this onto the end of the list.
+				arrput(uloc->files, ((FileInfo) {
+					.entry = entry,
+					.parent = dirIndex
+				}));
+			}
+			
+			// It's clearly not a file, so remove it
+			arrdel(uloc->files, i);
+			i--;
+			
+			closedir(dir);
+			
+			atomicStore(&uloc->progress.dirs, arrlen(uloc->dirs));
+			atomicStore(&uloc->progress.filesFound, arrlen(uloc->files) - i - 1);
+		}
+	}
+}
+
+static void findNameAndExtension(FileInfo *finfo) {
+	char *filepath = finfo->entry.start;
+	unat pathLength = finfo->entry.size;
+	
+	// Find filename by iterating backwards and checking for a slash/bslash
+	char *filename = filepath + pathLength - 1;
+	for(; filename >= filepath; filename--) {
+		if(filename[0] == '/' || filename[0] == '\\') {
+			break;
+		}
+	}
+	filename++;
+	
+	// Find file extension by iterating backwards and checking for a '.'
+	char *extension = filepath + pathLength - 1;
+	bool foundExtension = false;
+	for(; extension >= filename; extension--) {
+		if(extension[0] == '.') {
+			foundExtension = true;
+			break;
+		}
+	}
+	
+	if(!foundExtension) {
+		extension = NULL;
+	}
+	
+	finfo->name = (String) {
+		.size = strlen(filename),
+		.start = filename
+	};
+	
+	finfo->ext = (String) {
+		.size = extension ? strlen(extension) : 0,
+		.start = extension
+	};
+}
+
+// Reads a tar archive, or stdin, front to back. Stdin or gzipped files that aren't tar archives
+// become a file of their own
+static bool readArchiveStream(Uloc *uloc, FileInfo archive, bool isStdin, FileInfo **members, bool *gzipped, char **errorMessage) {
+	FILE *file = isStdin ? stdin : fopen(ulocFilePath(uloc, &archive).start, "rb");
+	if(file == NULL) {
+		*errorMessage = "could not open file";
+		return false;
+	}
+	
+	#ifdef _WIN32
+	if(isStdin) _setmode(_fileno(stdin), 0x8000);
+	#endif
+	
+	InputStream input;
+	inputOpen(&input, file);
+	
+	uint1 block[TAR_BLOCK_SIZE];
+	unat blockSize = inputRead(&input, block, TAR_BLOCK_SIZE);
+	bool ok = true;
+	
+	if(blockSize == TAR_BLOCK_SIZE && isTarHeader(block)) {
+		ok = readTar(&input, block, archive.entry, archive.parent, uloc->dotfiles, &uloc->names, members, errorMessage);
+	} else if(isStdin || !isTarPath(archive.entry)) {
+		// Stdin can't be read again, so keep what's already been read in front. The rest gets read
+		// straight into the file data, which doubles whenever it runs out of room
+		unat capacity = blockSize + INFLATE_BUFFER_SIZE;
+		FileData *fdata = malloc(sizeof(FileData) + capacity);
+		assert(fdata != NULL);
+		memcpy(fdata->data, block, blockSize);
+		fdata->size = blockSize;
+		while(blockSize > 0) {
+			if(capacity - fdata->size < INFLATE_BUFFER_SIZE) {
+				capacity *= 2;
+				fdata = realloc(fdata, sizeof(FileData) + capacity);
+				assert(fdata != NULL);
+			}
+			blockSize = inputRead(&input, fdata->data + fdata->size, capacity - fdata->size);
+			fdata->size += blockSize;
+		}
+		
+		if(fdata->size > 0) {
+			// Give back the room that's left over
+			FileData *fitted = realloc(fdata, sizeof(FileData) + fdata->size);
+			if(fitted != NULL) fdata = fitted;
+			archive.data = fdata;
+			arrput(*members, archive);
+		} else {
+			free(fdata);
+		}
+	} else if(blockSize > 0) {
+		*errorMessage = "not a tar archive";
+		ok = false;
+	}
+	
+	if(input.failed) {
+		*errorMessage = "broken gzip data";
+		ok = false;
+	}
+	
+	*gzipped = input.gzip;
+	inputClose(&input);
+	if(!isStdin) fclose(file);
+	return ok;
+}
+
+// Replaces the archive (or stdin, for "-") at `index` in the file list with the files in it, which
+// already have their data. When the archive breaks off, the members read until then are still there
+static bool expandArchive(Uloc *uloc, nat index, nat *memberCount, char **errorMessage) {
+	FileInfo archive = uloc->files[index];
+	bool isStdin = archive.parent < 0 && compareStrings(archive.entry, litToString("-")) == 0;
+	
+	FileInfo *members = NULL;
+	bool gzipped = false;
+	bool ok;
+	if(!isStdin && isZipPath(archive.entry)) {
+		ok = readZip(ulocFilePath(uloc, &archive).start, archive.entry, archive.parent, uloc->dotfiles, &uloc->names, &members, errorMessage);
+	} else {
+		ok = readArchiveStream(uloc, archive, isStdin, &members, &gzipped, errorMessage);
+	}
+	
+	arrdel(uloc->files, index);
+	arrinsn(uloc->files, index, arrlen(members));
+	for(nat i = 0; i < arrlen(members); i++) {
+		FileInfo *member = uloc->files + index + i;
+		*member = members[i];
+		findNameAndExtension(member);
+		
+		// Comments of "main.c.gz" get stripped like the ones of "main.c"
+		if(gzipped && member->ext.size == 3 && matchInsensitive(member->ext, litToString(".gz"))) {
+			char *extension = member->ext.start;
+			while(extension > member->name.start && extension[-1] != '.') extension--;
+			member->ext = extension > member->name.start + 1 ? (String) {
+				.size = member->ext.start - extension + 1,
+				.start = extension - 1
+			} : (String) {0};
+		}
+	}
+	
+	*memberCount = arrlen(members);
+	arrfree(members);
+	return ok;
+}
+
+// Split the file into lines, and keep its unique lines around as a sorted run for the total
+static void countLines(Uloc *uloc, FileInfo *finfo) {
+	decodeText(&finfo->data);
+	FileData *fdata = finfo->data;
+	unat runOffset = arrlen(uloc->lines);
+	
+	const CommentSyntax *syntax = uloc->stripComments ? findCommentSyntax(finfo->ext) : NULL;
+	bool inBlockComment = false;
+	
+	// Count number of lines which are not whitespace only, and put them into the lines array
+	char *start = fdata->data;
+	char *stop = start;
+	char *end = fdata->data + fdata->size;
+	while(stop < end) {
+		String line = {
+			.start = start
+		};
+		
+		// Keep moving up `stop` until LF or EOF
+		for(; stop < end && stop[0] != '\n'; stop++) {}
+		start = stop + 1;
+		
+		for(; line.start < stop; line.start++) {
+			if(!isWhitespace(line.start[0])) {
+				break;
+			}
+		}
+		
+		// `stop` is one past the end of the line, so look at the byte before it
+		for(; stop > line.start; stop--) {
+			if(!isWhitespace(stop[-1])) {
+				break;
+			}
+		}
+		
+		line.size = stop - line.start;
+		if(syntax != NULL && (line.size > 0 || inBlockComment)) {
+			line.size = stripComments(line.start, line.size, syntax, &inBlockComment);
+			line = trimLine(line);
+		}
+		
+		if(line.size > 0 && uloc->normalize) {
+			line.size = normalizeLine(line.start, line.size, uloc->normalize);
+		}
+		
+		if(line.size > 0 && ((uloc->skipTrivial && isTrivialLine(line)) || stopSetHas(&uloc->stopLines, line))) {
+			line.size = 0;
+		}
+		
+		if(line.size > 0) {
+			arrput(uloc->lines, line);
+			finfo->lineCount++;
+			if(uloc->histograms != NULL) uloc->histograms->lineLength[lengthBucket(line.size)]++;
+		}
+		
+		stop = start;
+	}
+	
+	sortLines(uloc->lines + runOffset, finfo->lineCount);
+	
+	if(uloc->collectFingerprints) arrput(uloc->fingerprintOffsets, arrlen(uloc->fingerprints));
+	
+	if(uloc->collectFingerprints || uloc->histograms != NULL) {
+		String *lines = uloc->lines + runOffset;
+		for(unat i = 0; i < finfo->lineCount;) {
+			unat repeat = i + 1;
+			while(repeat < finfo->lineCount && compareStrings(lines[i], lines[repeat]) == 0) repeat++;
+			
+			if(uloc->collectFingerprints) {
+				arrput(uloc->fingerprints, ((Fingerprint) {
+					.hash = lineFingerprint(lines[i]),
+					.count = repeat - i
+				}));
+			}
+			if(uloc->histograms != NULL) uloc->histograms->lineCopies[copiesBucket(repeat - i)]++;
+			i = repeat;
+		}
+	}
+	
+	// Only the unique lines are kept around for the total
+	finfo->lineCountUnique = dedupLines(uloc->lines + runOffset, finfo->lineCount);
+	if(uloc->histograms != NULL && finfo->lineCount > 0) {
+		unat bucket = finfo->lineCountUnique * RATIO_BUCKETS / finfo->lineCount;
+		uloc->histograms->fileRatio[bucket < RATIO_BUCKETS ? bucket : RATIO_BUCKETS - 1]++;
+	}
+	if(uloc->sketch.registers != NULL) {
+		for(unat i = 0; i < finfo->lineCountUnique; i++) {
+			sketchAdd(&uloc->sketch, lineFingerprint(uloc->lines[runOffset + i]));
+		}
+		arrsetlen(uloc->lines, runOffset);
+	} else {
+		arrsetlen(uloc->lines, runOffset + finfo->lineCountUnique);
+	}
+	arrput(uloc->runOffsets, runOffset);
+	
+	uloc->lineCount += finfo->lineCount;
+	atomicStore(&uloc->progress.lines, uloc->lineCount);
+	atomicStore(&uloc->progress.bytes, uloc->progress.bytes + fdata->size);
+}
+
+static inline LineRun memoryRun(Uloc *uloc, nat run) {
+	unat runEnd = run + 1 < arrlen(uloc->runOffsets) ? uloc->runOffsets[run + 1] : arrlen(uloc->lines);
+	return (LineRun) {
+		.lines = uloc->lines + uloc->runOffsets[run],
+		.count = runEnd - uloc->runOffsets[run]
+	};
+}
+
+// Everything that changes how lines get counted, for telling apart results saved to files
+static uint8 ulocSettings(Uloc *uloc) {
+	uint4 stopSignature = 0;
+	for(unat i = 0; i < uloc->stopLines.capacity; i++) {
+		String line = uloc->stopLines.slots[i];
+		if(line.start == NULL) continue;
+		
+		// FNV-1a, summed up so that the order doesn't matter
+		uint4 hash = 2166136261u;
+		for(unat c = 0; c < line.size; c++) hash = (hash ^ (uint1)line.start[c]) * 16777619u;
+		stopSignature += hash;
+	}
+	
+	return (uint8)stopSignature << 32 | uloc->normalize | uloc->stripComments << 8 | uloc->skipTrivial << 9;
+}
+
+// Every file left behind a sorted run of unique lines, either in memory or spilled to a temporary
+// file. Returns the runs ready for merging, free them with freeRuns()
+static LineRun *collectRuns(Uloc *uloc, bool withSpills, nat *runCount) {
+	nat spillCount = withSpills ? arrlen(uloc->spills) : 0;
+	nat memoryRunCount = arrlen(uloc->runOffsets);
+	*runCount = spillCount + memoryRunCount;
+	
+	LineRun *runs = malloc(sizeof(*runs) * (*runCount > 0 ? *runCount : 1));
+	assert(runs != NULL);
+	
+	for(nat r = 0; r < spillCount; r++) {
+		runOpenSpill(runs + r, uloc->spills[r]);
+	}
+	
+	for(nat r = 0; r < memoryRunCount; r++) {
+		runs[spillCount + r] = memoryRun(uloc, r);
+	}
+	
+	return runs;
+}
+
+static void freeRuns(LineRun *runs, nat runCount) {
+	for(nat r = 0; r < runCount; r++) runFree(runs + r);
+	free(runs);
+}
+
+static unat countMergedUnique(LineRun *runs, nat runCount) {
+	LineMerger merger;
+	mergerInit(&merger, runs, runCount);
+	
+	unat unique = 0;
+	String line, prev;
+	while(mergerNext(&merger, &line)) {
+		if(unique == 0 || compareStrings(prev, line) != 0) unique++;
+		prev = line;
+	}
+	
+	mergerFree(&merger);
+	return unique;
+}
+
+static unat countUniqueTotal(Uloc *uloc) {
+	if(uloc->sketch.registers != NULL) return sketchEstimate(&uloc->sketch);
+	
+	nat runCount;
+	LineRun *runs = collectRuns(uloc, true, &runCount);
+	unat unique = countMergedUnique(runs, runCount);
+	freeRuns(runs, runCount);
+	return unique;
+}
+
+// Merge the runs in memory into a single run in a temporary file, then let go of the lines and
+// the data of the files they came from (every file before `countedFiles`)
+static bool spillRuns(Uloc *uloc, nat countedFiles) {
+	FILE *spill = tmpfile();
+	if(spill == NULL) {
+		uloc->error = "could not create a temporary file";
+		return false;
+	}
+	
+	nat runCount;
+	LineRun *runs = collectRuns(uloc, false, &runCount);
+	
+	LineMerger merger;
+	mergerInit(&merger, runs, runCount);
+	
+	bool ok = true;
+	unat written = 0;
+	String line, prev;
+	while(mergerNext(&merger, &line)) {
+		if(written > 0 && compareStrings(prev, line) == 0) continue;
+		if(!writeSpilledLine(spill, line)) {
+			ok = false;
+			break;
+		}
+		written++;
+		prev = line;
+	}
+	
+	mergerFree(&merger);
+	freeRuns(runs, runCount);
+	
+	if(!ok || fflush(spill) != 0) {
+		fclose(spill);
+		uloc->error = "could not write to a temporary file";
+		return false;
+	}
+	
+	arrput(uloc->spills, spill);
+	arrsetlen(uloc->lines, 0);
+	arrsetlen(uloc->runOffsets, 0);
+	
+	for(nat i = uloc->firstResident; i < countedFiles; i++) {
+		free(uloc->files[i].data);
+		uloc->files[i].data = NULL;
+	}
+	uloc->firstResident = countedFiles;
+	uloc->memoryUsed = 0;
+	
+	return true;
+}
+
+// Call after counting a file. Returns false if lines had to be spilled, but that didn't work out
+static bool enforceMemoryLimit(Uloc *uloc, FileInfo *finfo) {
+	if(uloc->memoryLimit == 0) return true;
+	
+	// Files that came out of a cache never had their data read
+	uloc->memoryUsed += sizeof(FileData) + (finfo->data != NULL ? finfo->data->size : 0);
+	if(uloc->memoryUsed + arrlen(uloc->lines) * sizeof(String) <= uloc->memoryLimit) return true;
+	
+	return spillRuns(uloc, finfo - uloc->files + 1);
+}
+
+// Adds up the fingerprints of the files from `first` up to `last` into one sorted set, as an
+// stb_ds array. Needs `collectFingerprints` to have been on while counting them
+static Fingerprint *fingerprintTotals(Uloc *uloc, nat first, nat last) {
+	unat start = first < arrlen(uloc->fingerprintOffsets) ? uloc->fingerprintOffsets[first] : arrlen(uloc->fingerprints);
+	unat end = last < arrlen(uloc->fingerprintOffsets) ? uloc->fingerprintOffsets[last] : arrlen(uloc->fingerprints);
+	
+	Fingerprint *totals = NULL;
+	arrsetcap(totals, end - start + 1);
+	memcpy(arraddnptr(totals, end - start), uloc->fingerprints + start, (end - start) * sizeof(Fingerprint));
+	unat merged = mergeFingerprints(totals, end - start);
+	arrsetlen(totals, merged);
+	return totals;
+}
+
+/// Scanning state ///
+//////////////////////
+
+//////////////////
+/// Live index ///
+
+// Keeps the results of a set of files up to date as they change, without holding on to their
+// lines: every file keeps its fingerprints, and all files share a multiset of them counting how
+// often each line occurs overall. Updating a file only costs as much as counting that file again.
+// Totals are exact as long as no two different lines share a fingerprint.
+
+structdef(LiveFileStats) {
+	unat lineCount;
+	unat lineCountUnique;
+	Fingerprint *fingerprints; // stb_ds array
+};
+
+structdef(LiveFile) {
+	char *key;
+	LiveFileStats value;
+};
+
+structdef(LineOccurrences) {
+	uint8 key;
+	unat value;
+};
+
+structdef(LiveIndex) {
+	LiveFile *files; // stb_ds string hashmap by path
+	LineOccurrences *lines; // stb_ds hashmap by fingerprint
+	unat lineCount;
+};
+
+static void liveIndexInit(LiveIndex *index) {
+	*index = (LiveIndex) {0};
+	sh_new_strdup(index->files);
+}
+
+static void liveIndexFree(LiveIndex *index) {
+	for(nat i = 0; i < shlen(index->files); i++) {
+		arrfree(index->files[i].value.fingerprints);
+	}
+	shfree(index->files);
+	hmfree(index->lines);
+}
+
+static inline unat liveIndexUnique(LiveIndex *index) {
+	return hmlen(index->lines);
+}
+
+static void liveIndexAdd(LiveIndex *index, LiveFileStats *stats, int sign) {
+	for(nat i = 0; i < arrlen(stats->fingerprints); i++) {
+		Fingerprint fingerprint = stats->fingerprints[i];
+		nat found = hmgeti(index->lines, fingerprint.hash);
+		
+		if(sign > 0) {
+			if(found < 0) hmput(index->lines, fingerprint.hash, fingerprint.count);
+			else index->lines[found].value += fingerprint.count;
+		} else if(found >= 0) {
+			if(index->lines[found].value <= fingerprint.count) hmdel(index->lines, fingerprint.hash);
+			else index->lines[found].value -= fingerprint.count;
+		}
+	}
+	
+	if(sign > 0) index->lineCount += stats->lineCount;
+	else index->lineCount -= stats->lineCount;
+}
+
+// Forgets about a file. Returns false if it wasn't in the index
+static bool liveIndexRemove(LiveIndex *index, const char *path) {
+	nat found = shgeti(index->files, path);
+	if(found < 0) return false;
+	
+	liveIndexAdd(index, &index->files[found].value, -1);
+	arrfree(index->files[found].value.fingerprints);
+	shdel(index->files, path);
+	return true;
+}
+
+// Counts a file (again), using the options of `uloc` but leaving it as it was. Files that can't be
+// read or are empty get removed. `previous` gets what was known about the file before, if anything
+static bool liveIndexUpdate(LiveIndex *index, Uloc *uloc, const char *path, LiveFileStats *previous, char **errorMessage) {
+	*previous = (LiveFileStats) {0};
+	nat found = shgeti(index->files, path);
+	if(found >= 0) {
+		*previous = index->files[found].value;
+		previous->fingerprints = NULL;
+	}
+	
+	FileData *fdata = readFile((char*)path, errorMessage);
+	if(fdata == NULL) {
+		liveIndexRemove(index, path);
+		return false;
+	}
+	
+	FileInfo finfo = {
+		.entry = cstrToString(path),
+		.parent = -1,
+		.data = fdata
+	};
+	findNameAndExtension(&finfo);
+	
+	// Count it like any other file, then take back everything countLines() left in `uloc`
+	bool collectFingerprints = uloc->collectFingerprints;
+	unat linesBefore = arrlen(uloc->lines);
+	unat lineCountBefore = uloc->lineCount;
+	unat fingerprintsBefore = arrlen(uloc->fingerprints);
+	
+	uloc->collectFingerprints = true;
+	countLines(uloc, &finfo);
+	uloc->collectFingerprints = collectFingerprints;
+	
+	LiveFileStats stats = {
+		.lineCount = finfo.lineCount,
+		.lineCountUnique = finfo.lineCountUnique
+	};
+	unat fingerprintCount = arrlen(uloc->fingerprints) - fingerprintsBefore;
+	arrsetcap(stats.fingerprints, fingerprintCount + 1);
+	memcpy(arraddnptr(stats.fingerprints, fingerprintCount), uloc->fingerprints + fingerprintsBefore, fingerprintCount * sizeof(Fingerprint));
+	
+	arrsetlen(uloc->lines, linesBefore);
+	arrsetlen(uloc->fingerprints, fingerprintsBefore);
+	arrsetlen(uloc->runOffsets, arrlen(uloc->runOffsets) - 1);
+	arrsetlen(uloc->fingerprintOffsets, arrlen(uloc->fingerprintOffsets) - 1);
+	uloc->lineCount = lineCountBefore;
+	free(finfo.data);
+	
+	liveIndexRemove(index, path);
+	liveIndexAdd(index, &stats, 1);
+	shput(index->files, path, stats);
+	return true;
+}
+
+// How often a line occurs in all files, after it went through the same normalization as the lines
+// in them. Comments don't get stripped, since there's no file extension to go by. Changes `line`
+static unat liveIndexLineCount(LiveIndex *index, Uloc *uloc, String line) {
+	line = trimLine(line);
+	if(line.size > 0 && uloc->normalize) {
+		line.size = normalizeLine(line.start, line.size, uloc->normalize);
+	}
+	
+	if(line.size == 0 || (uloc->skipTrivial && isTrivialLine(line)) || stopSetHas(&uloc->stopLines, line)) return 0;
+	
+	nat found = hmgeti(index->lines, lineFingerprint(line));
+	return found >= 0 ? index->lines[found].value : 0;
+}
+
+/// Live index ///
+//////////////////
+
+//////////////////
+/// Line index ///
+
+// A saved set of fingerprints that also knows which files every line occurs in, so new files can
+// be checked against a corpus without scanning it again. Everything has a fixed size and is sorted
+// by hash, so the file gets mapped and searched as is:
+//   [16 byte magic][uint8 settings][uint8 lineCount][uint8 ownerCount][uint8 fileCount][uint8 pathSize]
+//   lineCount times [uint8 hash][uint8 count][uint8 firstOwner]
+//   ownerCount times [uint4 file id], padded to 8 bytes
+//   fileCount + 1 times [uint8 path offset]
+//   pathSize bytes of NUL terminated paths
+
+#define LINE_INDEX_MAGIC "uloc-line-index"
+#define LINE_INDEX_HEADER_SIZE (16 + 5 * 8)
+
+structdef(LineIndexEntry) {
+	uint8 hash;
+	uint8 count; // In all files together
+	uint8 firstOwner; // The owners run until the next entry's first one
+};
+
+structdef(LineIndex) {
+	MappedFile mapped;
+	uint8 settings;
+	const LineIndexEntry *lines;
+	unat lineCount;
+	const uint4 *owners;
+	unat ownerCount;
+	const uint8 *pathOffsets;
+	unat fileCount;
+	const char *paths;
+	unat pathSize;
+};
+
+structdef(LineOwner) {
+	uint8 hash;
+	uint8 count;
+	uint4 file;
+};
+
+static int compareLineOwners(const void *left, const void *right) {
+	const LineOwner *a = left;
+	const LineOwner *b = right;
+	if(a->hash != b->hash) return (a->hash > b->hash) - (a->hash < b->hash);
+	return (a->file > b->file) - (a->file < b->file);
+}
+
+// Saves the fingerprints `countLines()` collected for every file in `uloc->files`
+static bool saveLineIndex(Uloc *uloc, const char *path) {
+	unat fileCount = arrlen(uloc->fingerprintOffsets);
+	
+	LineOwner *owners = NULL;
+	arrsetcap(owners, arrlen(uloc->fingerprints) + 1);
+	for(unat f = 0; f < fileCount; f++) {
+		unat end = f + 1 < fileCount ? uloc->fingerprintOffsets[f + 1] : arrlen(uloc->fingerprints);
+		for(unat i = uloc->fingerprintOffsets[f]; i < end; i++) {
+			arrput(owners, ((LineOwner) {
+				.hash = uloc->fingerprints[i].hash,
+				.count = uloc->fingerprints[i].count,
+				.file = f
+			}));
+		}
+	}
+	
+	unat ownerCount = arrlen(owners);
+	if(ownerCount > 0) qsort(owners, ownerCount, sizeof(*owners), compareLineOwners);
+	
+	unat lineCount = 0;
+	for(unat i = 0; i < ownerCount; i++) {
+		lineCount += i == 0 || owners[i].hash != owners[i - 1].hash;
+	}
+	
+	uint8 pathSize = 0;
+	for(unat f = 0; f < fileCount; f++) {
+		pathSize += ulocFilePath(uloc, uloc->files + f).size + 1;
+	}
+	
+	FILE *file = fopen(path, "wb");
+	if(file == NULL) {
+		arrfree(owners);
+		return false;
+	}
+	
+	uint8 header[5] = {ulocSettings(uloc), lineCount, ownerCount, fileCount, pathSize};
+	bool ok = fwrite(LINE_INDEX_MAGIC, 1, 16, file) == 16;
+	ok = ok && fwrite(header, sizeof(header), 1, file) == 1;
+	
+	for(unat i = 0; ok && i < ownerCount;) {
+		LineIndexEntry entry = {
+			.hash = owners[i].hash,
+			.firstOwner = i
+		};
+		for(; i < ownerCount && owners[i].hash == entry.hash; i++) entry.count += owners[i].count;
+		ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+	}
+	
+	for(unat i = 0; ok && i < ownerCount; i++) {
+		ok = fwrite(&owners[i].file, sizeof(uint4), 1, file) == 1;
+	}
+	uint4 padding = 0;
+	if(ok && ownerCount % 2 != 0) ok = fwrite(&padding, sizeof(uint4), 1, file) == 1;
+	
+	uint8 offset = 0;
+	for(unat f = 0; ok && f <= fileCount; f++) {
+		ok = fwrite(&offset, sizeof(offset), 1, file) == 1;
+		if(f < fileCount) offset += ulocFilePath(uloc, uloc->files + f).size + 1;
+	}
+	
+	for(unat f = 0; ok && f < fileCount; f++) {
+		String filePath = ulocFilePath(uloc, uloc->files + f);
+		ok = fwrite(filePath.start, 1, filePath.size + 1, file) == filePath.size + 1;
+	}
+	
+	if(fclose(file) != 0) ok = false;
+	arrfree(owners);
+	return ok;
+}
+
+// Returns false if `path` isn't a saved line index
+static bool openLineIndex(const char *path, LineIndex *index) {
+	*index = (LineIndex) {0};
+	if(!mapFile(path, &index->mapped)) return false;
+	
+	const uint1 *data = index->mapped.data;
+	unat size = index->mapped.size;
+	uint8 header[5];
+	if(size < LINE_INDEX_HEADER_SIZE || memcmp(data, LINE_INDEX_MAGIC, 16) != 0) {
+		unmapFile(&index->mapped);
+		return false;
+	}
+	memcpy(header, data + 16, sizeof(header));
+	
+	// Check the sizes one at a time, so that none of them can overflow
+	unat available = size - LINE_INDEX_HEADER_SIZE;
+	bool ok = header[1] <= available / sizeof(LineIndexEntry);
+	if(ok) available -= header[1] * sizeof(LineIndexEntry);
+	ok = ok && header[2] <= available / sizeof(uint4);
+	unat ownersSize = (header[2] * sizeof(uint4) + 7) & ~(unat)7;
+	ok = ok && ownersSize <= available;
+	if(ok) available -= ownersSize;
+	ok = ok && header[3] < available / sizeof(uint8);
+	if(ok) available -= (header[3] + 1) * sizeof(uint8);
+	ok = ok && header[4] <= available;
+	
+	if(!ok) {
+		unmapFile(&index->mapped);
+		return false;
+	}
+	
+	index->settings = header[0];
+	index->lineCount = header[1];
+	index->ownerCount = header[2];
+	index->fileCount = header[3];
+	index->pathSize = header[4];
+	
+	const uint1 *at = data + LINE_INDEX_HEADER_SIZE;
+	index->lines = (const LineIndexEntry*)at;
+	at += index->lineCount * sizeof(LineIndexEntry);
+	index->owners = (const uint4*)at;
+	at += ownersSize;
+	index->pathOffsets = (const uint8*)at;
+	at += (index->fileCount + 1) * sizeof(uint8);
+	index->paths = (const char*)at;
+	return true;
+}
+
+static void closeLineIndex(LineIndex *index) {
+	unmapFile(&index->mapped);
+}
+
+static const LineIndexEntry *lineIndexFind(LineIndex *index, uint8 hash) {
+	unat low = 0, high = index->lineCount;
+	while(low < high) {
+		unat middle = low + (high - low) / 2;
+		if(index->lines[middle].hash == hash) return index->lines + middle;
+		if(index->lines[middle].hash < hash) low = middle + 1;
+		else high = middle;
+	}
+	return NULL;
+}
+
+// The files a line occurs in, as ids for `lineIndexPath()`
+static const uint4 *lineIndexOwners(LineIndex *index, const LineIndexEntry *entry, unat *count) {
+	unat first = entry->firstOwner;
+	unat end = entry + 1 < index->lines + index->lineCount ? entry[1].firstOwner : index->ownerCount;
+	if(first > end || end > index->ownerCount) end = first = 0;
+	
+	*count = end - first;
+	return index->owners + first;
+}
+
+static const char *lineIndexPath(LineIndex *index, uint4 file) {
+	if(file >= index->fileCount || index->pathOffsets[file] >= index->pathSize) return "?";
+	return index->paths + index->pathOffsets[file];
+}
+
+/// Line index ///
+//////////////////
+
+///////////////////
+/// Git history ///
+
+// Counts the files of commits straight from the object store. Every blob only gets split and
+// sorted once, commits that share it reuse its run of unique lines for their total
+
+// Comment stripping depends on the extension, so the same blob can count differently
+structdef(GitBlobKey) {
+	uint1 id[GIT_ID_SIZE];
+	int4 syntax;
+};
+
+structdef(GitBlob) {
+	GitBlobKey key;
+	nat value; // Index into `files`, which is also the index of its run
+};
+
+structdef(GitHistory) {
+	GitRepo repo;
+	GitBlob *blobs; // stb_ds hashmap
+	char *path;
+	nat *commitFiles;
+};
+
+structdef(GitCommitCount) {
+	GitCommit commit;
+	unat fileCount;
+	unat lineCount;
+	unat lineCountUnique;
+};
+
+static bool gitHistoryOpen(GitHistory *history, const char *path, char **errorMessage) {
+	*history = (GitHistory) {0};
+	return gitOpen(&history->repo, path, errorMessage);
+}
+
+static void gitHistoryClose(GitHistory *history) {
+	gitClose(&history->repo);
+	hmfree(history->blobs);
+	arrfree(history->path);
+	arrfree(history->commitFiles);
+}
+
+static bool countGitBlob(Uloc *uloc, GitHistory *history, const uint1 *id) {
+	// The path only gets copied for blobs that weren't seen before
+	unat pathSize = arrlen(history->path);
+	arrput(history->path, 0);
+	arrsetlen(history->path, pathSize);
+	
+	FileInfo finfo = {
+		.entry = {
+			.size = pathSize,
+			.start = history->path
+		},
+		.parent = -1
+	};
+	findNameAndExtension(&finfo);
+	
+	GitBlobKey key = {0};
+	memcpy(key.id, id, GIT_ID_SIZE);
+	const CommentSyntax *syntax = uloc->stripComments ? findCommentSyntax(finfo.ext) : NULL;
+	key.syntax = syntax != NULL ? (int4)(syntax - commentSyntaxes) : -1;
+	
+	nat cached = hmgeti(history->blobs, key);
+	if(cached >= 0) {
+		arrput(history->commitFiles, history->blobs[cached].value);
+		return true;
+	}
+	
+	GitObjectType type;
+	char *object = gitReadObject(&history->repo, id, &type);
+	if(object == NULL || type != GIT_BLOB) {
+		arrfree(object);
+		return false;
+	}
+	
+	finfo.entry.start = arenaCopy(&uloc->names, history->path, pathSize);
+	findNameAndExtension(&finfo);
+	
+	finfo.data = malloc(sizeof(FileData) + arrlen(object));
+	assert(finfo.data != NULL);
+	finfo.data->size = arrlen(object);
+	memcpy(finfo.data->data, object, arrlen(object));
+	arrfree(object);
+	
+	nat index = arrlen(uloc->files);
+	arrput(uloc->files, finfo);
+	countLines(uloc, uloc->files + index);
+	
+	hmput(history->blobs, key, index);
+	arrput(history->commitFiles, index);
+	return true;
+}
+
+// Walks a tree depth first, the path of the current entry is kept in `history->path`
+static bool walkGitTree(Uloc *uloc, GitHistory *history, const uint1 *treeId, int depth) {
+	GitObjectType type;
+	char *tree = gitReadObject(&history->repo, treeId, &type);
+	if(tree == NULL || type != GIT_TREE || depth > 256) {
+		arrfree(tree);
+		return false;
+	}
+	
+	bool ok = true;
+	unat pathSize = arrlen(history->path);
+	
+	char *at = tree;
+	char *end = tree + arrlen(tree);
+	GitTreeEntry entry;
+	while(ok && nextTreeEntry(&at, end, &entry)) {
+		if(!isFileMode(entry.mode)) continue;
+		if(!uloc->dotfiles && entry.name.start[0] == '.') continue;
+		
+		arrsetlen(history->path, pathSize);
+		if(pathSize > 0) arrput(history->path, uloc->slash);
+		memcpy(arraddnptr(history->path, entry.name.size), entry.name.start, entry.name.size);
+		
+		if(isTreeMode(entry.mode)) {
+			ok = walkGitTree(uloc, history, entry.id, depth + 1);
+		} else {
+			ok = countGitBlob(uloc, history, entry.id);
+		}
+	}
+	if(at != end) ok = false;
+	
+	arrsetlen(history->path, pathSize);
+	arrfree(tree);
+	return ok;
+}
+
+// Counts every file in the tree of a commit
+static bool countGitCommit(Uloc *uloc, GitHistory *history, const uint1 *commitId, GitCommitCount *count) {
+	*count = (GitCommitCount) {0};
+	if(!gitReadCommit(&history->repo, commitId, &count->commit)) {
+		uloc->error = "could not read commit";
+		return false;
+	}
+	
+	arrsetlen(history->commitFiles, 0);
+	arrsetlen(history->path, 0);
+	if(!walkGitTree(uloc, history, count->commit.tree, 0)) {
+		uloc->error = "could not read all objects of the commit";
+		return false;
+	}
+	
+	nat runCount = arrlen(history->commitFiles);
+	LineRun *runs = malloc(sizeof(*runs) * (runCount > 0 ? runCount : 1));
+	assert(runs != NULL);
+	
+	for(nat i = 0; i < runCount; i++) {
+		FileInfo *finfo = uloc->files + history->commitFiles[i];
+		count->lineCount += finfo->lineCount;
+		runs[i] = memoryRun(uloc, history->commitFiles[i]);
+	}
+	
+	count->fileCount = runCount;
+	count->lineCountUnique = countMergedUnique(runs, runCount);
+	freeRuns(runs, runCount);
+	
+	return true;
+}
+
+/// Git history ///
+///////////////////
+
+////////////////////
+/// Git worktree ///
+
+// Finds the git working tree around the current directory, and reads what .git/index knows about
+// its files: their blob ids, and the size and modification time they had when they were staged
+
+structdef(GitIndexEntry) {
+	uint1 id[GIT_ID_SIZE];
+	uint4 mtimeSeconds;
+	uint4 mtimeNanoseconds;
+	uint4 size;
+};
+
+structdef(GitIndexPath) {
+	char *key;
+	GitIndexEntry value;
+};
+
+structdef(GitWorktree) {
+	GitRepo repo;
+	char *root; // Normalized like worktreePath() does it
+	GitIndexPath *index; // stb_ds string hashmap, paths relative to the root with forward slashes
+	uint4 indexSeconds;
+	uint4 indexNanoseconds;
+	char *pathBuffer;
+};
+
+static inline uint4 readBigEndian2(const uint1 *bytes) {
+	return (uint4)bytes[0] << 8 | bytes[1];
+}
+
+static bool statFile(const char *path, uint8 *size, uint4 *seconds, uint4 *nanoseconds) {
+	#ifdef _WIN32
+	struct _stat64 st;
+	if(_stat64(path, &st) != 0) return false;
+	*nanoseconds = 0;
+	#else
+	struct stat st;
+	if(stat(path, &st) != 0) return false;
+	#if defined(__APPLE__)
+	*nanoseconds = st.st_mtimespec.tv_nsec;
+	#else
+	*nanoseconds = st.st_mtim.tv_nsec;
+	#endif
+	#endif
+	
+	*size = st.st_size;
+	*seconds = st.st_mtime;
+	return true;
+}
+
+// Reads the paths, blob ids and stat data of .git/index (versions 2 to 4)
+static bool readGitIndex(GitWorktree *worktree) {
+	char path[4096 + 16];
+	snprintf(path, sizeof(path), "%s/index", worktree->repo.gitDir);
+	
+	uint8 indexSize;
+	if(!statFile(path, &indexSize, &worktree->indexSeconds, &worktree->indexNanoseconds)) return false;
+	
+	MappedFile mapped;
+	if(!mapFile(path, &mapped)) return false;
+	
+	const uint1 *at = mapped.data;
+	const uint1 *end = mapped.data + mapped.size;
+	uint4 version = mapped.size >= 12 ? readBigEndian4(at + 4) : 0;
+	if(version < 2 || version > 4 || memcmp(at, "DIRC", 4) != 0) {
+		unmapFile(&mapped);
+		return false;
+	}
+	
+	uint4 entryCount = readBigEndian4(at + 8);
+	at += 12;
+	
+	sh_new_arena(worktree->index);
+	
+	// Version 4 only stores how much of the previous path to drop, and what to append
+	char *name = NULL;
+	
+	bool ok = true;
+	for(uint4 i = 0; i < entryCount; i++) {
+		// ctime, mtime, dev, ino, mode, uid, gid and size are 4 bytes each, then the id and flags
+		const uint1 *entry = at;
+		if(end - at < 62) {
+			ok = false;
+			break;
+		}
+		
+		uint4 flags = readBigEndian2(entry + 60);
+		at += 62;
+		if(version >= 3 && (flags & 0x4000)) at += 2;
+		
+		if(version == 4) {
+			unat drop = 0;
+			uint1 byte;
+			do {
+				if(at >= end) break;
+				byte = *at++;
+				drop = (drop << 7) | (byte & 0x7f);
+				if(byte & 0x80) drop++;
+			} while(byte & 0x80);
+			
+			if(drop > (unat)arrlen(name)) {
+				ok = false;
+				break;
+			}
+			arrsetlen(name, arrlen(name) - drop);
+		} else {
+			arrsetlen(name, 0);
+		}
+		
+		const uint1 *nameEnd = memchr(at, 0, end - at);
+		if(nameEnd == NULL) {
+			ok = false;
+			break;
+		}
+		memcpy(arraddnptr(name, nameEnd - at), at, nameEnd - at);
+		arrput(name, 0);
+		arrsetlen(name, arrlen(name) - 1);
+		
+		if(version == 4) {
+			at = nameEnd + 1;
+		} else {
+			// Entries are padded with NULs to a multiple of 8 bytes
+			unat entrySize = (nameEnd - entry + 8) & ~(unat)7;
+			at = entry + entrySize;
+		}
+		
+		// Entries that are in the middle of a merge aren't useful
+		if((flags >> 12) & 3) continue;
+		
+		GitIndexEntry value = {
+			.mtimeSeconds = readBigEndian4(entry + 8),
+			.mtimeNanoseconds = readBigEndian4(entry + 12),
+			.size = readBigEndian4(entry + 36)
+		};
+		memcpy(value.id, entry + 40, GIT_ID_SIZE);
+		shput(worktree->index, name, value);
+	}
+	
+	arrfree(name);
+	unmapFile(&mapped);
+	return ok;
+}
+
+// Appends the components of `path` to `buffer` as "/component", resolving "." and ".." on the way
+static void appendNormalizedPath(char **buffer, const char *path) {
+	const char *at = path;
+	for(;;) {
+		while(*at == '/' || *at == '\\') at++;
+		if(*at == 0) break;
+		
+		const char *componentEnd = at;
+		while(*componentEnd != 0 && *componentEnd != '/' && *componentEnd != '\\') componentEnd++;
+		unat size = componentEnd - at;
+		
+		if(size == 2 && at[0] == '.' && at[1] == '.') {
+			while(arrlen(*buffer) > 0 && arrpop(*buffer) != '/') {}
+		} else if(!(size == 1 && at[0] == '.')) {
+			arrput(*buffer, '/');
+			memcpy(arraddnptr(*buffer, size), at, size);
+		}
+		
+		at = componentEnd;
+	}
+}
+
+// Goes up from the current directory until it finds a .git, like git does. Returns false if
+// there's no working tree around, or its index can't be read
+static bool gitWorktreeOpen(GitWorktree *worktree) {
+	*worktree = (GitWorktree) {0};
+	
+	char root[4096];
+	if(getcwd(root, sizeof(root)) == NULL) return false;
+	
+	for(;;) {
+		char candidate[4096 + 8];
+		snprintf(candidate, sizeof(candidate), "%s/.git", root);
+		
+		char *errorMessage;
+		if(isDirectory(candidate) || probeFile(candidate, &errorMessage)) break;
+		
+		char *slash = strrchr(root, '/');
+		#ifdef _WIN32
+		char *backslash = strrchr(root, '\\');
+		if(backslash > slash) slash = backslash;
+		#endif
+		if(slash == NULL || slash[1] == 0) return false;
+		
+		// Keep the root slash
+		if(slash == root) slash++;
+		*slash = 0;
+	}
+	
+	char *errorMessage;
+	if(!gitOpen(&worktree->repo, root, &errorMessage)) return false;
+	appendNormalizedPath(&worktree->root, root);
+	
+	if(!readGitIndex(worktree)) {
+		gitClose(&worktree->repo);
+		return false;
+	}
+	
+	return true;
+}
+
+static void gitWorktreeClose(GitWorktree *worktree) {
+	gitClose(&worktree->repo);
+	shfree(worktree->index);
+	arrfree(worktree->root);
+	arrfree(worktree->pathBuffer);
+}
+
+// Lexically turns `path` into a path relative to the worktree, with forward slashes, and leaves
+// it in `worktree->pathBuffer`. Returns false for paths outside of the worktree
+static bool worktreePath(GitWorktree *worktree, const char *path) {
+	arrsetlen(worktree->pathBuffer, 0);
+	
+	bool absolute = path[0] == '/' || path[0] == '\\' || (path[0] != 0 && path[1] == ':');
+	if(!absolute) {
+		char cwd[4096];
+		if(getcwd(cwd, sizeof(cwd)) == NULL) return false;
+		appendNormalizedPath(&worktree->pathBuffer, cwd);
+	}
+	appendNormalizedPath(&worktree->pathBuffer, path);
+	arrput(worktree->pathBuffer, 0);
+	
+	unat rootSize = arrlen(worktree->root);
+	if((unat)arrlen(worktree->pathBuffer) <= rootSize + 1) return false;
+	if(memcmp(worktree->pathBuffer, worktree->root, rootSize) != 0 || worktree->pathBuffer[rootSize] != '/') return false;
+	
+	arrdeln(worktree->pathBuffer, 0, rootSize + 1);
+	return true;
+}
+
+// Finds the index entry of a file, or NULL if it isn't tracked. `clean` tells if the file still
+// looks like it did when it was staged
+static GitIndexEntry *worktreeEntry(GitWorktree *worktree, const char *path, bool *clean) {
+	*clean = false;
+	if(worktree->index == NULL || !worktreePath(worktree, path)) return NULL;
+	
+	nat found = shgeti(worktree->index, worktree->pathBuffer);
+	if(found < 0) return NULL;
+	GitIndexEntry *entry = &worktree->index[found].value;
+	
+	uint8 size;
+	uint4 seconds, nanoseconds;
+	if(!statFile(path, &size, &seconds, &nanoseconds)) return entry;
+	if((uint4)size != entry->size || seconds != entry->mtimeSeconds) return entry;
+	
+	#ifndef _WIN32
+	if(nanoseconds != entry->mtimeNanoseconds) return entry;
+	#endif
+	
+	// A file changed in the same second the index got written might not show up as changed
+	if(seconds > worktree->indexSeconds || (seconds == worktree->indexSeconds && nanoseconds >= worktree->indexNanoseconds)) return entry;
+	
+	*clean = true;
+	return entry;
+}
+
+// Collects the blob ids of every file in a tree, by their path relative to it with forward slashes
+static bool listGitTree(GitRepo *repo, const uint1 *treeId, char **path, GitIndexPath **paths, int depth) {
+	GitObjectType type;
+	char *tree = gitReadObject(repo, treeId, &type);
+	if(tree == NULL || type != GIT_TREE || depth > 256) {
+		arrfree(tree);
+		return false;
+	}
+	
+	bool ok = true;
+	unat pathSize = arrlen(*path);
+	
+	char *at = tree;
+	char *end = tree + arrlen(tree);
+	GitTreeEntry entry;
+	while(ok && nextTreeEntry(&at, end, &entry)) {
+		if(!isFileMode(entry.mode)) continue;
+		
+		arrsetlen(*path, pathSize);
+		if(pathSize > 0) arrput(*path, '/');
+		memcpy(arraddnptr(*path, entry.name.size), entry.name.start, entry.name.size);
+		
+		if(isTreeMode(entry.mode)) {
+			ok = listGitTree(repo, entry.id, path, paths, depth + 1);
+		} else {
+			GitIndexEntry value = {0};
+			memcpy(value.id, entry.id, GIT_ID_SIZE);
+			arrput(*path, 0);
+			shput(*paths, *path, value);
+		}
+	}
+	if(at != end) ok = false;
+	
+	arrsetlen(*path, pathSize);
+	arrfree(tree);
+	return ok;
+}
+
+// Files count as changed since `base` if they're staged or modified, or not in `base` at all
+static bool changedSince(GitWorktree *worktree, GitIndexPath *base, const char *path) {
+	bool clean;
+	GitIndexEntry *entry = worktreeEntry(worktree, path, &clean);
+	if(entry == NULL || !clean) return true;
+	
+	nat found = shgeti(base, worktree->pathBuffer);
+	return found < 0 || memcmp(base[found].value.id, entry->id, GIT_ID_SIZE) != 0;
+}
+
+/// Git worktree ///
+////////////////////
+
+//////////////////
+/// Blob cache ///
+
+// Keeps the results of files in a git working tree between runs, keyed by the blob id .git/index
+// has for them. A file whose size and modification time still match its index entry hasn't
+// changed since it was staged, so its counts and sorted unique lines come out of the cache instead
+// of getting read and split again. The cache only depends on blob ids, so it can be shared between
+// branches and worktrees.
+//
+// The cache file is a header followed by one entry per blob:
+//   [20 byte id][int4 syntax][uint8 lineCount][uint8 lineCountUnique][uint8 size of lines]
+//   followed by the unique lines in sorted order, each as [uint4 size][bytes]
+// Entries get copied over into a fresh file on every run, so blobs that are gone drop out.
+
+#define BLOB_CACHE_MAGIC "uloc-blobcache-2"
+#define BLOB_CACHE_HEADER_SIZE (16 + 8)
+#define BLOB_CACHE_ENTRY_SIZE (GIT_ID_SIZE + 4 + 8 * 3)
+
+structdef(BlobCacheSlot) {
+	GitBlobKey key;
+	unat value; // Offset of the entry in the old cache file
+};
+
+structdef(BlobCache) {
+	GitWorktree *worktree; // NULL outside of a git working tree
+	MappedFile old;
+	BlobCacheSlot *entries; // stb_ds hashmap
+	uint8 settings;
+	
+	char *path;
+	char *tempPath;
+	FILE *out;
+	BlobCacheSlot *written; // stb_ds hashmap, value unused
+	bool failed;
+};
+
+// Returns false if the cache can't be used at all. Not being in a git working tree (`worktree` is
+// NULL) isn't an error, there just won't be any blob ids to key on
+static bool blobCacheOpen(BlobCache *cache, Uloc *uloc, GitWorktree *worktree, const char *path, char **errorMessage) {
+	*cache = (BlobCache) {
+		.worktree = worktree
+	};
+	
+	cache->settings = ulocSettings(uloc);
+	
+	unat pathSize = strlen(path);
+	memcpy(arraddnptr(cache->path, pathSize + 1), path, pathSize + 1);
+	memcpy(arraddnptr(cache->tempPath, pathSize), path, pathSize);
+	memcpy(arraddnptr(cache->tempPath, 5), ".tmp", 5);
+	
+	// A cache written with other settings (or garbage) just gets ignored
+	if(mapFile(path, &cache->old)) {
+		uint8 settings = 0;
+		if(cache->old.size >= BLOB_CACHE_HEADER_SIZE) memcpy(&settings, cache->old.data + 16, 8);
+		
+		if(cache->old.size < BLOB_CACHE_HEADER_SIZE || memcmp(cache->old.data, BLOB_CACHE_MAGIC, 16) != 0 || settings != cache->settings) {
+			unmapFile(&cache->old);
+		}
+	}
+	
+	unat offset = BLOB_CACHE_HEADER_SIZE;
+	while(cache->old.data != NULL && offset + BLOB_CACHE_ENTRY_SIZE <= cache->old.size) {
+		BlobCacheSlot slot = {.value = offset};
+		memcpy(&slot.key, cache->old.data + offset, sizeof(slot.key));
+		
+		uint8 linesSize;
+		memcpy(&linesSize, cache->old.data + offset + GIT_ID_SIZE + 4 + 16, 8);
+		if(linesSize > cache->old.size - offset - BLOB_CACHE_ENTRY_SIZE) break;
+		
+		hmputs(cache->entries, slot);
+		offset += BLOB_CACHE_ENTRY_SIZE + linesSize;
+	}
+	
+	cache->out = fopen(cache->tempPath, "wb");
+	if(cache->out == NULL) {
+		*errorMessage = "could not create the cache file";
+		return false;
+	}
+	
+	cache->failed = fwrite(BLOB_CACHE_MAGIC, 1, 16, cache->out) != 16 || fwrite(&cache->settings, 8, 1, cache->out) != 1;
+	return true;
+}
+
+// Finds the blob id of a file, if it's tracked and hasn't changed since it was staged
+static bool blobCacheKey(BlobCache *cache, Uloc *uloc, FileInfo *finfo, const char *path, GitBlobKey *key) {
+	// The cache doesn't know how often lines occur within a file, which fingerprints need
+	if(cache->worktree == NULL || uloc->collectFingerprints) return false;
+	
+	bool clean;
+	GitIndexEntry *entry = worktreeEntry(cache->worktree, path, &clean);
+	if(entry == NULL || !clean) return false;
+	
+	*key = (GitBlobKey) {0};
+	memcpy(key->id, entry->id, GIT_ID_SIZE);
+	const CommentSyntax *syntax = uloc->stripComments ? findCommentSyntax(finfo->ext) : NULL;
+	key->syntax = syntax != NULL ? (int4)(syntax - commentSyntaxes) : -1;
+	return true;
+}
+
+static void blobCacheWrite(BlobCache *cache, const void *data, unat size) {
+	if(!cache->failed && size > 0 && fwrite(data, 1, size, cache->out) != size) cache->failed = true;
+}
+
+// Takes the lines of a file from the cache instead of counting them. They point into the mapped
+// cache file, which stays around until blobCacheClose()
+static bool blobCacheLoad(BlobCache *cache, Uloc *uloc, FileInfo *finfo, GitBlobKey key) {
+	nat found = hmgeti(cache->entries, key);
+	if(found < 0) return false;
+	
+	const uint1 *entry = cache->old.data + cache->entries[found].value;
+	uint8 lineCount, lineCountUnique, linesSize;
+	memcpy(&lineCount, entry + GIT_ID_SIZE + 4, 8);
+	memcpy(&lineCountUnique, entry + GIT_ID_SIZE + 4 + 8, 8);
+	memcpy(&linesSize, entry + GIT_ID_SIZE + 4 + 16, 8);
+	
+	unat runOffset = arrlen(uloc->lines);
+	const uint1 *at = entry + BLOB_CACHE_ENTRY_SIZE;
+	const uint1 *end = at + linesSize;
+	for(uint8 i = 0; i < lineCountUnique; i++) {
+		uint4 size;
+		if(end - at < 4) break;
+		memcpy(&size, at, 4);
+		if((unat)(end - at - 4) < size) break;
+		
+		arrput(uloc->lines, ((String) {.size = size, .start = (char*)at + 4}));
+		at += 4 + size;
+	}
+	
+	if((unat)arrlen(uloc->lines) - runOffset != lineCountUnique || at != end) {
+		arrsetlen(uloc->lines, runOffset);
+		return false;
+	}
+	
+	arrput(uloc->runOffsets, runOffset);
+	finfo->lineCount = lineCount;
+	finfo->lineCountUnique = lineCountUnique;
+	uloc->lineCount += lineCount;
+	
+	if(hmgeti(cache->written, key) < 0) {
+		hmput(cache->written, key, 0);
+		blobCacheWrite(cache, entry, BLOB_CACHE_ENTRY_SIZE + linesSize);
+	}
+	
+	return true;
+}
+
+// Call right after counting a file, while its run is still the last one in memory
+static void blobCacheStore(BlobCache *cache, Uloc *uloc, FileInfo *finfo, GitBlobKey key) {
+	if(hmgeti(cache->written, key) >= 0) return;
+	hmput(cache->written, key, 0);
+	
+	String *lines = uloc->lines + arrlast(uloc->runOffsets);
+	uint8 linesSize = 0;
+	for(unat i = 0; i < finfo->lineCountUnique; i++) linesSize += 4 + lines[i].size;
+	
+	uint8 lineCount = finfo->lineCount;
+	uint8 lineCountUnique = finfo->lineCountUnique;
+	blobCacheWrite(cache, &key, sizeof(key));
+	blobCacheWrite(cache, &lineCount, 8);
+	blobCacheWrite(cache, &lineCountUnique, 8);
+	blobCacheWrite(cache, &linesSize, 8);
+	
+	for(unat i = 0; i < finfo->lineCountUnique; i++) {
+		uint4 size = lines[i].size;
+		blobCacheWrite(cache, &size, 4);
+		blobCacheWrite(cache, lines[i].start, lines[i].size);
+	}
+}
+
+// Replaces the old cache file with the new one, unless writing it failed somewhere. Lines loaded
+// from the cache are gone afterwards
+static bool blobCacheClose(BlobCache *cache) {
+	unmapFile(&cache->old);
+	
+	bool ok = !cache->failed;
+	if(fclose(cache->out) != 0) ok = false;
+	
+	if(ok) {
+		#ifdef _WIN32
+		remove(cache->path);
+		#endif
+		ok = rename(cache->tempPath, cache->path) == 0;
+	}
+	if(!ok) remove(cache->tempPath);
+	
+	hmfree(cache->entries);
+	hmfree(cache->written);
+	arrfree(cache->path);
+	arrfree(cache->tempPath);
+	
+	return ok;
+}
+
+/// Blob cache ///
+//////////////////
+
+//////////////////
+/// Public API ///
+
+#define _ULOC_STR(x) #x
+#define ULOC_STR(x) _ULOC_STR(x)
+
+ULOC_API const char *uloc_version(void) {
+	return ULOC_STR(ULOC_MAJOR) "." ULOC_STR(ULOC_MINOR) "." ULOC_STR(ULOC_PATCH);
+}
+
+ULOC_API Uloc *uloc_create(void) {
+	Uloc *uloc = calloc(1, sizeof(Uloc));
+	if(uloc == NULL) return NULL;
+	
+	checkStopTable();
+	
+	#ifdef _WIN32
+	uloc->slash = '\\';
+	#else
+	uloc->slash = '/';
+	#endif
+	
+	return uloc;
+}
+
+ULOC_API void uloc_free(Uloc *uloc) {
+	if(uloc == NULL) return;
+	
+	for(nat i = 0; i < arrlen(uloc->files); i++) {
+		free(uloc->files[i].data);
+	}
+	
+	arrfree(uloc->files);
+	arrfree(uloc->dirs);
+	arenaFree(&uloc->names);
+	arrfree(uloc->pathBuffer);
+	arrfree(uloc->lines);
+	arrfree(uloc->runOffsets);
+	free(uloc->stopLines.slots);
+	arenaFree(&uloc->stopLines.lines);
+	arrfree(uloc->fingerprints);
+	arrfree(uloc->fingerprintOffsets);
+	sketchFree(&uloc->sketch);
+	
+	for(nat i = 0; i < arrlen(uloc->spills); i++) {
+		fclose(uloc->spills[i]);
+	}
+	arrfree(uloc->spills);
+	
+	free(uloc);
+}
+
+ULOC_API void uloc_setFlag(Uloc *uloc, UlocFlag flag, int value) {
+	switch(flag) {
+		case ULOC_DOTFILES: uloc->dotfiles = value != 0; break;
+		case ULOC_SLASH: uloc->slash = (char)value; break;
+		case ULOC_NORMALIZE: uloc->normalize = value; break;
+		case ULOC_STRIP_COMMENTS: uloc->stripComments = value != 0; break;
+		case ULOC_SKIP_TRIVIAL: uloc->skipTrivial = value != 0; break;
+	}
+}
+
+ULOC_API int uloc_scanBuffer(Uloc *uloc, const char *path, const void *data, size_t size) {
+	if(path == NULL || path[0] == 0) {
+		uloc->error = "file path must not be empty";
+		return -1;
+	}
+	
+	if(size == 0) return 0;
+	
+	FileData *fdata = malloc(sizeof(FileData) + size);
+	if(fdata == NULL) {
+		uloc->error = "could not allocate memory";
+		return -1;
+	}
+	
+	fdata->size = size;
+	memcpy(fdata->data, data, size);
+	
+	unat pathSize = strlen(path);
+	FileInfo finfo = {
+		.entry = {
+			.size = pathSize,
+			.start = arenaCopy(&uloc->names, path, pathSize)
+		},
+		.parent = -1,
+		.data = fdata
+	};
+	findNameAndExtension(&finfo);
+	
+	arrput(uloc->files, finfo);
+	countLines(uloc, &arrlast(uloc->files));
+	
+	return enforceMemoryLimit(uloc, &arrlast(uloc->files)) ? 0 : -1;
+}
+
+ULOC_API int uloc_scanPath(Uloc *uloc, const char *path) {
+	if(path == NULL || path[0] == 0) {
+		uloc->error = "file path must not be empty";
+		return -1;
+	}
+	
+	unat pathSize = strlen(path);
+	nat first = arrlen(uloc->files);
+	arrput(uloc->files, ((FileInfo) {
+		.entry = {
+			.size = pathSize,
+			.start = arenaCopy(&uloc->names, path, pathSize)
+		},
+		.parent = -1
+	}));
+	
+	findFiles(uloc, first);
+	
+	int status = 0;
+	for(nat i = first; i < arrlen(uloc->files); i++) {
+		FileInfo *finfo = uloc->files + i;
+		findNameAndExtension(finfo);
+		
+		char *errorMessage = NULL;
+		finfo->data = readFile(ulocFilePath(uloc, finfo).start, &errorMessage);
+		
+		if(errorMessage != NULL) {
+			uloc->error = errorMessage;
+			status = -1;
+		}
+		
+		// Remove file from our list if we couldn't read it or it was empty
+		if(finfo->data == NULL) {
+			arrdel(uloc->files, i);
+			i--;
+			continue;
+		}
+		
+		countLines(uloc, finfo);
+		if(!enforceMemoryLimit(uloc, finfo)) status = -1;
+	}
+	
+	return status;
+}
+
+ULOC_API void uloc_setMemoryLimit(Uloc *uloc, size_t bytes) {
+	uloc->memoryLimit = bytes;
+}
+
+// Stop lines go through the same trimming and normalization as the lines they get compared against
+static void addStopLine(Uloc *uloc, const char *line, unat size) {
+	String stopLine = trimLine((String) {
+		.size = size,
+		.start = arenaCopy(&uloc->stopLines.lines, line, size)
+	});
+	
+	if(stopLine.size > 0 && uloc->normalize) {
+		stopLine.size = normalizeLine(stopLine.start, stopLine.size, uloc->normalize);
+	}
+	
+	stopSetAdd(&uloc->stopLines, stopLine);
+}
+
+ULOC_API void uloc_addStopLine(Uloc *uloc, const char *line, size_t size) {
+	addStopLine(uloc, line, size);
+}
+
+ULOC_API const char *uloc_lastError(Uloc *uloc) {
+	return uloc->error;
+}
+
+ULOC_API size_t uloc_fileCount(Uloc *uloc) {
+	return arrlen(uloc->files);
+}
+
+ULOC_API int uloc_file(Uloc *uloc, size_t index, UlocFile *file) {
+	if(index >= (size_t)arrlen(uloc->files)) {
+		uloc->error = "file index out of range";
+		return -1;
+	}
+	
+	FileInfo *finfo = uloc->files + index;
+	*file = (UlocFile) {
+		.path = ulocFilePath(uloc, finfo).start,
+		.name = finfo->name.start,
+		.ext = finfo->ext.start,
+		.lineCount = finfo->lineCount,
+		.lineCountUnique = finfo->lineCountUnique
+	};
+	
+	return 0;
+}
+
+ULOC_API void uloc_totals(Uloc *uloc, size_t *lineCount, size_t *lineCountUnique) {
+	if(lineCount != NULL) *lineCount = uloc->lineCount;
+	if(lineCountUnique != NULL) *lineCountUnique = countUniqueTotal(uloc);
+}
+
+/// Public API ///
+//////////////////
+
+#endif // ULOC_IMPLEMENTATION